@@ -158,6 +158,93 @@ void aes128_encrypt_block(struct aes128_ctx_t *ctx, const uint8_t plaintext[stat
 	aes_xor_bytes(ciphertext, &ctx->round_key[AES_ROUNDS - 1], 16);
 }
 
+static void aes_sub_bytes_masked(const struct aes128_masked_ctx_t *mctx, uint8_t block[static 16], uint8_t mask[static 16]) {
+	/* Convert the mask of every byte to the input mask of the table first so
+	 * that the unmasked value never appears; the table lookup then yields
+	 * S(x) ^ m', which is masked with mask[i] again. The state leaves with
+	 * mask[i] ^ m'. */
+	uint8_t conversion[16];
+	for (unsigned int i = 0; i < 16; i++) {
+		conversion[i] = mask[i] ^ mctx->mask_in;
+	}
+	for (unsigned int i = 0; i < 16; i++) {
+		block[i] = mctx->sbox[block[i] ^ conversion[i]] ^ mask[i];
+		mask[i] ^= mctx->mask_out;
+	}
+}
+
+static void aes_mix_columns_masked(const struct aes128_masked_ctx_t *mctx, uint8_t block[static 16], uint8_t mask[static 16]) {
+	for (int col = 0; col < 4; col++) {
+		/* MixColumns is linear, so the masks of the column are mixed
+		 * alongside the state; all bytes of a column carry different masks,
+		 * so no combination of two bytes is unmasked. Afterwards, the column
+		 * is remasked with the fresh per-byte masks. */
+		uint8_t conversion[4];
+		memcpy(conversion, mask + 4 * col, 4);
+		aes_mix_column(block + 4 * col);
+		aes_mix_column(conversion);
+		for (int i = 0; i < 4; i++) {
+			conversion[i] ^= mctx->mask[4 * col + i];
+		}
+		for (int i = 0; i < 4; i++) {
+			block[4 * col + i] ^= conversion[i];
+		}
+		memcpy(mask + 4 * col, mctx->mask + 4 * col, 4);
+	}
+}
+
+/* Boolean masking with an independent mask for every state byte, taken from
+ * the 16 bytes of randomness. The S-box is precomputed once for an input mask
+ * m and an output mask m' != m, each the XOR of one half of the randomness:
+ * 16 independent bytes plus two independent S-box masks would require more
+ * randomness than there is, and a single table mask for input and output
+ * would make the lookup itself leak x ^ S(x) in the Hamming distance model.
+ * Every state byte's current mask is tracked through ShiftRows and
+ * MixColumns and converted to m right before the table lookup.
+ *
+ * All bytes enter the table masked with the same m, so the Hamming distance
+ * of two consecutive table indices that share a register still leaks the
+ * XOR of two S-box inputs. This is inherent to a single masked table. */
+void aes128_masked_init(struct aes128_masked_ctx_t *mctx, const uint8_t randomness[static 16]) {
+	memcpy(mctx->mask, randomness, 16);
+	mctx->mask_in = 0;
+	mctx->mask_out = 0;
+	for (unsigned int i = 0; i < 8; i++) {
+		mctx->mask_in ^= randomness[i];
+		mctx->mask_out ^= randomness[8 + i];
+	}
+	if (mctx->mask_in == mctx->mask_out) {
+		mctx->mask_out ^= 0x01;
+	}
+	for (unsigned int i = 0; i < 256; i++) {
+		mctx->sbox[i ^ mctx->mask_in] = sbox[i] ^ mctx->mask_out;
+	}
+}
+
+void aes128_encrypt_block_masked(struct aes128_ctx_t *ctx, const struct aes128_masked_ctx_t *mctx, const uint8_t plaintext[static 16], uint8_t ciphertext[static 16]) {
+	/* Current mask of every state byte */
+	uint8_t mask[16];
+	memcpy(mask, mctx->mask, 16);
+	for (unsigned int i = 0; i < 16; i++) {
+		ciphertext[i] = plaintext[i] ^ mask[i];
+	}
+	for (unsigned int rnd = 0; rnd < AES_ROUNDS - 1; rnd++) {
+		/* Add round key, masks remain unchanged */
+		aes_xor_bytes(ciphertext, &ctx->round_key[rnd], 16);
+
+		aes_sub_bytes_masked(mctx, ciphertext, mask);
+		aes_shift_rows(ciphertext);
+		aes_shift_rows(mask);
+		if (rnd != AES_ROUNDS - 2) {
+			aes_mix_columns_masked(mctx, ciphertext, mask);
+		}
+	}
+	aes_xor_bytes(ciphertext, &ctx->round_key[AES_ROUNDS - 1], 16);
+	for (unsigned int i = 0; i < 16; i++) {
+		ciphertext[i] ^= mask[i];
+	}
+}
+
 static void aes_rot_word(uint8_t word[static 4]) {
 	uint8_t tmp = word[0];
 	word[0] = word[1];
@@ -9,8 +9,17 @@ struct aes128_ctx_t {
 	uint8_t round_key[AES_ROUNDS][16];
 };
 
+struct aes128_masked_ctx_t {
+	uint8_t mask[16];
+	uint8_t mask_in;
+	uint8_t mask_out;
+	uint8_t sbox[256];
+};
+
 /*************** AUTO GENERATED SECTION FOLLOWS ***************/
 void aes128_encrypt_block(struct aes128_ctx_t *ctx, const uint8_t plaintext[static 16], uint8_t ciphertext[static 16]);
+void aes128_masked_init(struct aes128_masked_ctx_t *mctx, const uint8_t randomness[static 16]);
+void aes128_encrypt_block_masked(struct aes128_ctx_t *ctx, const struct aes128_masked_ctx_t *mctx, const uint8_t plaintext[static 16], uint8_t ciphertext[static 16]);
 void aes128_dump(const struct aes128_ctx_t *ctx);
 void aes128_init(struct aes128_ctx_t *ctx, const uint8_t key[static 16]);
 /***************  AUTO GENERATED SECTION ENDS   ***************/
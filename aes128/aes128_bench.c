@@ -0,0 +1,102 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "aes128.h"
+#include "aes128_bitsliced.h"
+
+#define BENCH_MIN_RUNTIME_SECS	1.0
+
+static double now_secs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+/* Key search throughput of the bitsliced implementation: a fresh key per lane
+ * is checked against a known plaintext/ciphertext pair, as done when
+ * enumerating key candidates. */
+static void bench_bitsliced_match(const uint8_t key[static 16]) {
+	uint8_t keys[AES128_BITSLICED_LANES][16];
+	uint8_t plaintext[16] = { 0 };
+	uint8_t ciphertext[16];
+	struct aes128_ctx_t aes;
+	aes128_init(&aes, key);
+	aes128_encrypt_block(&aes, plaintext, ciphertext);
+
+	for (unsigned int i = 0; i < AES128_BITSLICED_LANES; i++) {
+		memcpy(keys[i], key, 16);
+		keys[i][0] ^= i;
+	}
+
+	unsigned long long candidates = 0;
+	unsigned long long matches = 0;
+	const double t0 = now_secs();
+	double t1;
+	do {
+		for (unsigned int i = 0; i < 64; i++) {
+			keys[0][1]++;
+			matches += __builtin_popcountll(aes128_bitsliced_match(keys, AES128_BITSLICED_LANES, plaintext, ciphertext));
+			candidates += AES128_BITSLICED_LANES;
+		}
+		t1 = now_secs();
+	} while (t1 - t0 < BENCH_MIN_RUNTIME_SECS);
+
+	const double runtime = t1 - t0;
+	printf("{\"benchmark\": \"aes128_bitsliced_match\", \"keys\": %llu, \"runtime_secs\": %.6f, \"keys_per_sec\": %.1f, \"matches\": %llu}\n", candidates, runtime, candidates / runtime, matches);
+}
+
+/* Host throughput of aes128_encrypt_block() with a fixed key, chained so
+ * that the compiler cannot hoist anything out of the loop. Emits JSON. */
+int main(int argc, char **argv) {
+	const uint8_t key[16] = { 0xa6, 0x17, 0xdb, 0x75, 0x31, 0x0a, 0x5f, 0x1c, 0xc7, 0x24, 0x1b, 0xfc, 0xd9, 0xcb, 0x93, 0xe0 };
+	uint8_t block[16] = { 0 };
+
+	struct aes128_ctx_t aes;
+	aes128_init(&aes, key);
+
+	unsigned long long blocks = 0;
+	const double t0 = now_secs();
+	double t1;
+	do {
+		for (unsigned int i = 0; i < 4096; i++) {
+			aes128_encrypt_block(&aes, block, block);
+		}
+		blocks += 4096;
+		t1 = now_secs();
+	} while (t1 - t0 < BENCH_MIN_RUNTIME_SECS);
+
+	const double runtime = t1 - t0;
+	printf("{\"benchmark\": \"aes128_encrypt_block\", \"blocks\": %llu, \"runtime_secs\": %.6f, \"blocks_per_sec\": %.1f, \"last_block\": \"", blocks, runtime, blocks / runtime);
+	for (unsigned int i = 0; i < 16; i++) {
+		printf("%02x", block[i]);
+	}
+	printf("\"}\n");
+
+	bench_bitsliced_match(key);
+	return 0;
+}
@@ -0,0 +1,328 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#include <stdint.h>
+#include <string.h>
+#include "aes128.h"
+#include "aes128_bitsliced.h"
+
+/* Bitsliced AES-128 for the host that encrypts up to 64 blocks at once, every
+ * lane with its own key. Slice (8 * byte + bit) holds that bit of that state
+ * byte for all lanes, one lane per bit of the uint64_t. The S-box is a Boolean
+ * circuit, so it needs neither tables nor data-dependent memory accesses. */
+
+typedef uint64_t slice_t;
+
+static const uint8_t Rcon[AES_ROUNDS] = {
+	0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+};
+
+/* Boyar-Peralta S-box circuit (113 gates); U0 and S0 are the MSBs */
+static void bs_sbox(slice_t x[static 8]) {
+	const slice_t U0 = x[7], U1 = x[6], U2 = x[5], U3 = x[4], U4 = x[3], U5 = x[2], U6 = x[1], U7 = x[0];
+	const slice_t T1 = U0 ^ U3;
+	const slice_t T2 = U0 ^ U5;
+	const slice_t T3 = U0 ^ U6;
+	const slice_t T4 = U3 ^ U5;
+	const slice_t T5 = U4 ^ U6;
+	const slice_t T6 = T1 ^ T5;
+	const slice_t T7 = U1 ^ U2;
+	const slice_t T8 = U7 ^ T6;
+	const slice_t T9 = U7 ^ T7;
+	const slice_t T10 = T6 ^ T7;
+	const slice_t T11 = U1 ^ U5;
+	const slice_t T12 = U2 ^ U5;
+	const slice_t T13 = T3 ^ T4;
+	const slice_t T14 = T6 ^ T11;
+	const slice_t T15 = T5 ^ T11;
+	const slice_t T16 = T5 ^ T12;
+	const slice_t T17 = T9 ^ T16;
+	const slice_t T18 = U3 ^ U7;
+	const slice_t T19 = T7 ^ T18;
+	const slice_t T20 = T1 ^ T19;
+	const slice_t T21 = U6 ^ U7;
+	const slice_t T22 = T7 ^ T21;
+	const slice_t T23 = T2 ^ T22;
+	const slice_t T24 = T2 ^ T10;
+	const slice_t T25 = T20 ^ T17;
+	const slice_t T26 = T3 ^ T16;
+	const slice_t T27 = T1 ^ T12;
+	const slice_t M1 = T13 & T6;
+	const slice_t M2 = T23 & T8;
+	const slice_t M3 = T14 ^ M1;
+	const slice_t M4 = T19 & U7;
+	const slice_t M5 = M4 ^ M1;
+	const slice_t M6 = T3 & T16;
+	const slice_t M7 = T22 & T9;
+	const slice_t M8 = T26 ^ M6;
+	const slice_t M9 = T20 & T17;
+	const slice_t M10 = M9 ^ M6;
+	const slice_t M11 = T1 & T15;
+	const slice_t M12 = T4 & T27;
+	const slice_t M13 = M12 ^ M11;
+	const slice_t M14 = T2 & T10;
+	const slice_t M15 = M14 ^ M11;
+	const slice_t M16 = M3 ^ M2;
+	const slice_t M17 = M5 ^ T24;
+	const slice_t M18 = M8 ^ M7;
+	const slice_t M19 = M10 ^ M15;
+	const slice_t M20 = M16 ^ M13;
+	const slice_t M21 = M17 ^ M15;
+	const slice_t M22 = M18 ^ M13;
+	const slice_t M23 = M19 ^ T25;
+	const slice_t M24 = M22 ^ M23;
+	const slice_t M25 = M22 & M20;
+	const slice_t M26 = M21 ^ M25;
+	const slice_t M27 = M20 ^ M21;
+	const slice_t M28 = M23 ^ M25;
+	const slice_t M29 = M28 & M27;
+	const slice_t M30 = M26 & M24;
+	const slice_t M31 = M20 & M23;
+	const slice_t M32 = M27 & M31;
+	const slice_t M33 = M27 ^ M25;
+	const slice_t M34 = M21 & M22;
+	const slice_t M35 = M24 & M34;
+	const slice_t M36 = M24 ^ M25;
+	const slice_t M37 = M21 ^ M29;
+	const slice_t M38 = M32 ^ M33;
+	const slice_t M39 = M23 ^ M30;
+	const slice_t M40 = M35 ^ M36;
+	const slice_t M41 = M38 ^ M40;
+	const slice_t M42 = M37 ^ M39;
+	const slice_t M43 = M37 ^ M38;
+	const slice_t M44 = M39 ^ M40;
+	const slice_t M45 = M42 ^ M41;
+	const slice_t M46 = M44 & T6;
+	const slice_t M47 = M40 & T8;
+	const slice_t M48 = M39 & U7;
+	const slice_t M49 = M43 & T16;
+	const slice_t M50 = M38 & T9;
+	const slice_t M51 = M37 & T17;
+	const slice_t M52 = M42 & T15;
+	const slice_t M53 = M45 & T27;
+	const slice_t M54 = M41 & T10;
+	const slice_t M55 = M44 & T13;
+	const slice_t M56 = M40 & T23;
+	const slice_t M57 = M39 & T19;
+	const slice_t M58 = M43 & T3;
+	const slice_t M59 = M38 & T22;
+	const slice_t M60 = M37 & T20;
+	const slice_t M61 = M42 & T1;
+	const slice_t M62 = M45 & T4;
+	const slice_t M63 = M41 & T2;
+	const slice_t L0 = M61 ^ M62;
+	const slice_t L1 = M50 ^ M56;
+	const slice_t L2 = M46 ^ M48;
+	const slice_t L3 = M47 ^ M55;
+	const slice_t L4 = M54 ^ M58;
+	const slice_t L5 = M49 ^ M61;
+	const slice_t L6 = M62 ^ L5;
+	const slice_t L7 = M46 ^ L3;
+	const slice_t L8 = M51 ^ M59;
+	const slice_t L9 = M52 ^ M53;
+	const slice_t L10 = M53 ^ L4;
+	const slice_t L11 = M60 ^ L2;
+	const slice_t L12 = M48 ^ M51;
+	const slice_t L13 = M50 ^ L0;
+	const slice_t L14 = M52 ^ M61;
+	const slice_t L15 = M55 ^ L1;
+	const slice_t L16 = M56 ^ L0;
+	const slice_t L17 = M57 ^ L1;
+	const slice_t L18 = M58 ^ L8;
+	const slice_t L19 = M63 ^ L4;
+	const slice_t L20 = L0 ^ L1;
+	const slice_t L21 = L1 ^ L7;
+	const slice_t L22 = L3 ^ L12;
+	const slice_t L23 = L18 ^ L2;
+	const slice_t L24 = L15 ^ L9;
+	const slice_t L25 = L6 ^ L10;
+	const slice_t L26 = L7 ^ L9;
+	const slice_t L27 = L8 ^ L10;
+	const slice_t L28 = L11 ^ L14;
+	const slice_t L29 = L11 ^ L17;
+	x[7] = L6 ^ L24;
+	x[6] = ~(L16 ^ L26);
+	x[5] = ~(L19 ^ L28);
+	x[4] = L6 ^ L21;
+	x[3] = L20 ^ L22;
+	x[2] = L25 ^ L29;
+	x[1] = ~(L13 ^ L27);
+	x[0] = ~(L6 ^ L23);
+}
+
+static void bs_xtime(const slice_t x[static 8], slice_t result[static 8]) {
+	result[0] = x[7];
+	result[1] = x[0] ^ x[7];
+	result[2] = x[1];
+	result[3] = x[2] ^ x[7];
+	result[4] = x[3] ^ x[7];
+	result[5] = x[4];
+	result[6] = x[5];
+	result[7] = x[6];
+}
+
+static void bs_sub_bytes(slice_t state[static 128]) {
+	for (int i = 0; i < 16; i++) {
+		bs_sbox(state + (8 * i));
+	}
+}
+
+static void bs_shift_rows(slice_t state[static 128]) {
+	slice_t old[128];
+	memcpy(old, state, sizeof(old));
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			const int src = row + (4 * ((col + row) % 4));
+			memcpy(state + (8 * (row + (4 * col))), old + (8 * src), 8 * sizeof(slice_t));
+		}
+	}
+}
+
+static void bs_mix_columns(slice_t state[static 128]) {
+	for (int col = 0; col < 4; col++) {
+		slice_t *b0 = state + (8 * ((4 * col) + 0));
+		slice_t *b1 = state + (8 * ((4 * col) + 1));
+		slice_t *b2 = state + (8 * ((4 * col) + 2));
+		slice_t *b3 = state + (8 * ((4 * col) + 3));
+		slice_t b0x2[8], b1x2[8], b2x2[8], b3x2[8];
+		bs_xtime(b0, b0x2);
+		bs_xtime(b1, b1x2);
+		bs_xtime(b2, b2x2);
+		bs_xtime(b3, b3x2);
+		for (int i = 0; i < 8; i++) {
+			const slice_t e0 = b0x2[i] ^ b1x2[i] ^ b1[i] ^ b2[i] ^ b3[i];
+			const slice_t e1 = b0[i] ^ b1x2[i] ^ b2x2[i] ^ b2[i] ^ b3[i];
+			const slice_t e2 = b0[i] ^ b1[i] ^ b2x2[i] ^ b3x2[i] ^ b3[i];
+			const slice_t e3 = b0x2[i] ^ b0[i] ^ b1[i] ^ b2[i] ^ b3x2[i];
+			b0[i] = e0;
+			b1[i] = e1;
+			b2[i] = e2;
+			b3[i] = e3;
+		}
+	}
+}
+
+static void bs_add_round_key(slice_t state[static 128], const slice_t round_key[static 128]) {
+	for (int i = 0; i < 128; i++) {
+		state[i] ^= round_key[i];
+	}
+}
+
+/* Derives the next round key in place */
+static void bs_next_round_key(slice_t round_key[static 128], unsigned int rnd) {
+	slice_t word[32];
+
+	/* RotWord of the last word */
+	memcpy(word + 0, round_key + (8 * 13), 8 * sizeof(slice_t));
+	memcpy(word + 8, round_key + (8 * 14), 8 * sizeof(slice_t));
+	memcpy(word + 16, round_key + (8 * 15), 8 * sizeof(slice_t));
+	memcpy(word + 24, round_key + (8 * 12), 8 * sizeof(slice_t));
+	for (int i = 0; i < 4; i++) {
+		bs_sbox(word + (8 * i));
+	}
+	for (int i = 0; i < 8; i++) {
+		if ((Rcon[rnd] >> i) & 1) {
+			word[i] = ~word[i];
+		}
+	}
+
+	for (int i = 0; i < 32; i++) {
+		round_key[i] ^= word[i];
+	}
+	for (int i = 32; i < 128; i++) {
+		round_key[i] ^= round_key[i - 32];
+	}
+}
+
+static void bs_pack(const uint8_t (*blocks)[16], unsigned int count, slice_t slices[static 128]) {
+	memset(slices, 0, 128 * sizeof(slice_t));
+	for (unsigned int lane = 0; lane < count; lane++) {
+		for (int byte = 0; byte < 16; byte++) {
+			const uint8_t value = blocks[lane][byte];
+			for (int bit = 0; bit < 8; bit++) {
+				slices[(8 * byte) + bit] |= (slice_t)((value >> bit) & 1) << lane;
+			}
+		}
+	}
+}
+
+static void bs_broadcast(const uint8_t block[static 16], slice_t slices[static 128]) {
+	for (int byte = 0; byte < 16; byte++) {
+		for (int bit = 0; bit < 8; bit++) {
+			slices[(8 * byte) + bit] = ((block[byte] >> bit) & 1) ? ~(slice_t)0 : 0;
+		}
+	}
+}
+
+static void bs_encrypt(slice_t state[static 128], slice_t round_key[static 128]) {
+	for (unsigned int rnd = 1; rnd < AES_ROUNDS; rnd++) {
+		bs_add_round_key(state, round_key);
+		bs_sub_bytes(state);
+		bs_shift_rows(state);
+		if (rnd != AES_ROUNDS - 1) {
+			bs_mix_columns(state);
+		}
+		bs_next_round_key(round_key, rnd);
+	}
+	bs_add_round_key(state, round_key);
+}
+
+void aes128_bitsliced_encrypt(const uint8_t (*keys)[16], const uint8_t (*plaintexts)[16], unsigned int count, uint8_t (*ciphertexts)[16]) {
+	slice_t state[128], round_key[128];
+	if (count > AES128_BITSLICED_LANES) {
+		count = AES128_BITSLICED_LANES;
+	}
+	bs_pack(plaintexts, count, state);
+	bs_pack(keys, count, round_key);
+	bs_encrypt(state, round_key);
+
+	for (unsigned int lane = 0; lane < count; lane++) {
+		for (int byte = 0; byte < 16; byte++) {
+			uint8_t value = 0;
+			for (int bit = 0; bit < 8; bit++) {
+				value |= ((state[(8 * byte) + bit] >> lane) & 1) << bit;
+			}
+			ciphertexts[lane][byte] = value;
+		}
+	}
+}
+
+/* Encrypts the same plaintext under up to 64 candidate keys and returns a
+ * bitmask of the lanes whose ciphertext matches. */
+uint64_t aes128_bitsliced_match(const uint8_t (*keys)[16], unsigned int count, const uint8_t plaintext[static 16], const uint8_t ciphertext[static 16]) {
+	slice_t state[128], round_key[128], expected[128];
+	if (count > AES128_BITSLICED_LANES) {
+		count = AES128_BITSLICED_LANES;
+	}
+	bs_broadcast(plaintext, state);
+	bs_pack(keys, count, round_key);
+	bs_encrypt(state, round_key);
+
+	bs_broadcast(ciphertext, expected);
+	slice_t mismatch = 0;
+	for (int i = 0; i < 128; i++) {
+		mismatch |= state[i] ^ expected[i];
+	}
+	const slice_t lane_mask = (count == 64) ? ~(slice_t)0 : (((slice_t)1 << count) - 1);
+	return ~mismatch & lane_mask;
+}
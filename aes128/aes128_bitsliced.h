@@ -0,0 +1,36 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#ifndef __AES128_BITSLICED_H__
+#define __AES128_BITSLICED_H__
+
+#include <stdint.h>
+
+#define AES128_BITSLICED_LANES		64
+
+/*************** AUTO GENERATED SECTION FOLLOWS ***************/
+void aes128_bitsliced_encrypt(const uint8_t (*keys)[16], const uint8_t (*plaintexts)[16], unsigned int count, uint8_t (*ciphertexts)[16]);
+uint64_t aes128_bitsliced_match(const uint8_t (*keys)[16], unsigned int count, const uint8_t plaintext[static 16], const uint8_t ciphertext[static 16]);
+/***************  AUTO GENERATED SECTION ENDS   ***************/
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "aes128.h"
+#include "aes128_bitsliced.h"
 
 struct testcase_t {
 	const char *key, *plaintext, *ciphertext;
@@ -77,6 +78,55 @@ int main(int argc, char **argv) {
 			printf(" FAIL");
 		}
 		printf("\n");
+
+		struct aes128_masked_ctx_t masked;
+		uint8_t randomness[16];
+		for (unsigned int j = 0; j < 16; j++) {
+			randomness[j] = (0x35 * (i + j)) ^ (13 * j) ^ 0xa7;
+		}
+		aes128_masked_init(&masked, randomness);
+		aes128_encrypt_block_masked(&aes, &masked, plaintext, ciphertext);
+		printf("TC %d: masked with m = %02x, m' = %02x", i, masked.mask_in, masked.mask_out);
+		if (!memcmp(expected_ciphertext, ciphertext, 16)) {
+			printf(" PASS");
+		} else {
+			printf(" but computed C = ");
+			dump_block(ciphertext);
+			printf(" FAIL");
+		}
+		printf("\n");
+	}
+
+	/* All test vectors at once through the bitsliced implementation */
+	const unsigned int tc_count = sizeof(testcases) / sizeof(testcases[0]);
+	uint8_t keys[AES128_BITSLICED_LANES][16];
+	uint8_t plaintexts[AES128_BITSLICED_LANES][16];
+	uint8_t ciphertexts[AES128_BITSLICED_LANES][16];
+	for (unsigned int i = 0; i < tc_count; i++) {
+		parse_block(testcases[i].key, keys[i]);
+		parse_block(testcases[i].plaintext, plaintexts[i]);
+	}
+	aes128_bitsliced_encrypt(keys, plaintexts, tc_count, ciphertexts);
+	for (unsigned int i = 0; i < tc_count; i++) {
+		uint8_t expected_ciphertext[16];
+		parse_block(testcases[i].ciphertext, expected_ciphertext);
+		printf("TC %d: bitsliced", i);
+		if (!memcmp(expected_ciphertext, ciphertexts[i], 16)) {
+			printf(" PASS");
+		} else {
+			printf(" but computed C = ");
+			dump_block(ciphertexts[i]);
+			printf(" FAIL");
+		}
+		printf("\n");
+	}
+
+	/* Only the lane carrying the correct key may match */
+	for (unsigned int i = 0; i < tc_count; i++) {
+		uint8_t expected_ciphertext[16];
+		parse_block(testcases[i].ciphertext, expected_ciphertext);
+		const uint64_t match = aes128_bitsliced_match(keys, tc_count, plaintexts[i], expected_ciphertext);
+		printf("TC %d: bitsliced key match %s\n", i, (match == (1ULL << i)) ? "PASS" : "FAIL");
 	}
 
 	return 0;
@@ -0,0 +1,206 @@
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+
+import os
+import sys
+import json
+import array
+from Tracefile import Tracefile
+from DPAKernels import DPAKernels
+
+# Sufficient statistics of the first-order attack: for every keybyte i and
+# every value P of plaintext byte i, the sum of all traces and their number.
+# The differential trace of any guess is a linear combination of these, so the
+# state can be updated with new traces, merged with the state of other
+# machines and saved to a checkpoint without ever revisiting old traces.
+class AttackState():
+	_MAGIC = b"DPASTATE"
+	_VERSION = 1
+
+	def __init__(self, sample_count = None):
+		self._sample_count = sample_count
+		self._trace_count = 0
+		self._key = None
+		self._known_pair = None
+		self._sample_map = None
+		self._tracefiles = [ ]
+		self._fingerprints = set()
+		self._class_counts = array.array("Q", bytes(8 * 16 * DPAKernels.CLASS_COUNT))
+		self._class_sums = None if (sample_count is None) else DPAKernels.zeros("d", 16 * DPAKernels.CLASS_COUNT * sample_count)
+
+	@property
+	def sample_count(self):
+		return self._sample_count
+
+	@property
+	def trace_count(self):
+		return self._trace_count
+
+	@property
+	def key(self):
+		return self._key
+
+	@property
+	def known_pair(self):
+		# One plaintext/ciphertext pair, e.g., to verify enumerated keys
+		return self._known_pair
+
+	@property
+	def sample_map(self):
+		return self._sample_map
+
+	@property
+	def tracefiles(self):
+		# Digest and number of the traces taken from every tracefile so far
+		return self._tracefiles
+
+	def _set_key(self, key):
+		if key is None:
+			return
+		key = bytes(key)
+		if (self._key is not None) and (self._key != key):
+			raise Exception("Traces were recorded with different keys: %s and %s" % (self._key.hex(), key.hex()))
+		self._key = key
+
+	def class_counts(self, i):
+		offset = i * DPAKernels.CLASS_COUNT
+		return self._class_counts[offset : offset + DPAKernels.CLASS_COUNT]
+
+	def class_sums(self, i):
+		length = DPAKernels.CLASS_COUNT * self._sample_count
+		return self._class_sums[i * length : (i + 1) * length]
+
+	def update(self, tracefile, max_traces = None, thread_count = None):
+		# Of the first max_traces traces, those that are already part of the
+		# state (e.g., when a tracefile is given again with a larger limit)
+		# are skipped; returns the number of traces added
+		traces = list(tracefile)[:max_traces]
+		fingerprints = [ Tracefile.fingerprint(trace) for trace in traces ]
+		indices = [ index for (index, fingerprint) in enumerate(fingerprints) if fingerprint not in self._fingerprints ]
+		if len(indices) == 0:
+			return 0
+		if self._sample_count is None:
+			(samples, trace_count, self._sample_count) = tracefile.sample_matrix(indices = indices)
+			self._class_sums = DPAKernels.zeros("d", 16 * DPAKernels.CLASS_COUNT * self._sample_count)
+		else:
+			(samples, trace_count, _) = tracefile.sample_matrix(0, self._sample_count, indices = indices)
+		self._tracefiles.append({ "digest": tracefile.digest(indices = indices), "trace_count": trace_count })
+		self._fingerprints.update(fingerprints[index] for index in indices)
+
+		# Every trace belongs to 16 classes, one per keybyte
+		traces = [ traces[index] for index in indices ]
+		classes = array.array("I", ((i * DPAKernels.CLASS_COUNT) + trace["plaintext"][i] for trace in traces for i in range(16)))
+		class_counts = DPAKernels.zeros("I", 16 * DPAKernels.CLASS_COUNT)
+		DPAKernels.accumulate_classes(samples, self._sample_count, classes, 16, trace_count, self._class_sums, class_counts, thread_count = thread_count)
+		for (index, count) in enumerate(class_counts):
+			self._class_counts[index] += count
+		self._trace_count += trace_count
+		self._set_key(tracefile.correct_key)
+		if self._known_pair is None:
+			self._known_pair = (bytes(traces[0]["plaintext"]), bytes(traces[0]["ciphertext"]))
+		if self._sample_map is None:
+			self._sample_map = tracefile.sample_map
+		return trace_count
+
+	def merge(self, other):
+		if other.trace_count == 0:
+			return
+		if self._sample_count is None:
+			self._sample_count = other.sample_count
+			self._class_sums = DPAKernels.zeros("d", 16 * DPAKernels.CLASS_COUNT * self._sample_count)
+		elif other.sample_count != self._sample_count:
+			raise Exception("Cannot merge attack states with different trace lengths (%d and %d samples)." % (self._sample_count, other.sample_count))
+		if not self._fingerprints.isdisjoint(other._fingerprints):
+			raise Exception("Cannot merge attack states that share %d traces." % (len(self._fingerprints & other._fingerprints)))
+		self._set_key(other.key)
+		self._tracefiles += other.tracefiles
+		self._fingerprints |= other._fingerprints
+		DPAKernels.add_sums(self._class_sums, other._class_sums)
+		for index in range(len(self._class_counts)):
+			self._class_counts[index] += other._class_counts[index]
+		self._trace_count += other.trace_count
+		if self._known_pair is None:
+			self._known_pair = other.known_pair
+		if self._sample_map is None:
+			self._sample_map = other.sample_map
+
+	def write(self, filename):
+		header = {
+			"version":			self._VERSION,
+			"sample_count":		self._sample_count,
+			"trace_count":		self._trace_count,
+			"key":				None if (self._key is None) else self._key.hex(),
+			"plaintext":		None if (self._known_pair is None) else self._known_pair[0].hex(),
+			"ciphertext":		None if (self._known_pair is None) else self._known_pair[1].hex(),
+			"sample_map":		self._sample_map,
+			"tracefiles":		self._tracefiles,
+			"fingerprint_count":	len(self._fingerprints),
+		}
+		header = json.dumps(header).encode("utf-8")
+
+		# Write to a temporary file first so that an interrupted run never
+		# leaves a truncated checkpoint behind
+		tmp_filename = filename + ".tmp"
+		with open(tmp_filename, "wb") as f:
+			f.write(self._MAGIC)
+			f.write(len(header).to_bytes(4, byteorder = "little"))
+			f.write(header)
+			for data in [ self._class_counts, self._class_sums, array.array("Q", sorted(self._fingerprints)) ]:
+				if data is None:
+					continue
+				if sys.byteorder != "little":
+					data = array.array(data.typecode, data)
+					data.byteswap()
+				data.tofile(f)
+		os.replace(tmp_filename, filename)
+
+	@classmethod
+	def read(cls, filename):
+		with open(filename, "rb") as f:
+			if f.read(len(cls._MAGIC)) != cls._MAGIC:
+				raise Exception("%s is not an attack state checkpoint." % (filename))
+			header_length = int.from_bytes(f.read(4), byteorder = "little")
+			header = json.loads(f.read(header_length).decode("utf-8"))
+			if header["version"] != cls._VERSION:
+				raise Exception("%s has unsupported checkpoint version %d." % (filename, header["version"]))
+			state = cls(header["sample_count"])
+			state._trace_count = header["trace_count"]
+			if header["key"] is not None:
+				state._key = bytes.fromhex(header["key"])
+			if header["plaintext"] is not None:
+				state._known_pair = (bytes.fromhex(header["plaintext"]), bytes.fromhex(header["ciphertext"]))
+			state._sample_map = header.get("sample_map")
+			state._tracefiles = header.get("tracefiles", [ ])
+			state._class_counts = array.array("Q")
+			state._class_counts.fromfile(f, 16 * DPAKernels.CLASS_COUNT)
+			if state._sample_count is not None:
+				state._class_sums = array.array("d")
+				state._class_sums.fromfile(f, 16 * DPAKernels.CLASS_COUNT * state._sample_count)
+			fingerprints = array.array("Q")
+			fingerprints.fromfile(f, header.get("fingerprint_count", 0))
+			if sys.byteorder != "little":
+				state._class_counts.byteswap()
+				if state._class_sums is not None:
+					state._class_sums.byteswap()
+				fingerprints.byteswap()
+			state._fingerprints = set(fingerprints)
+		return state
@@ -0,0 +1,215 @@
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import os
+import ctypes
+import array
+
+# Thin ctypes binding for libdpakernels.so (build it with "make" in this
+# directory). All buffers are array.array instances that are handed to the
+# native code without copying.
+class DPAKernels():
+	COMBINE_CENTERED_PRODUCT = 0
+	COMBINE_ABSOLUTE_DIFFERENCE = 1
+	CLASS_COUNT = 256
+	KEY_NOT_FOUND = 0
+	KEY_FOUND = 1
+	KEY_ENUM_OUT_OF_MEMORY = 2
+	TEMPLATE_MAX_POINTS = 256
+
+	_lib = None
+
+	@classmethod
+	def _library(cls):
+		if cls._lib is None:
+			filename = os.path.dirname(os.path.realpath(__file__)) + "/libdpakernels.so"
+			if not os.path.isfile(filename):
+				raise Exception("%s not found; run 'make' in the recovery/ directory first." % (filename))
+			lib = ctypes.CDLL(filename)
+			lib.dpa_accumulate_pairs.restype = None
+			lib.dpa_accumulate_pairs.argtypes = [ ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint, ctypes.c_int, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_accumulate_classes.restype = None
+			lib.dpa_accumulate_classes.argtypes = [ ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_uint, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_subset_ranks.restype = ctypes.c_bool
+			lib.dpa_subset_ranks.argtypes = [ ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint8, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_class_projection.restype = None
+			lib.dpa_class_projection.argtypes = [ ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_class_combine.restype = None
+			lib.dpa_class_combine.argtypes = [ ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_add_sums.restype = None
+			lib.dpa_add_sums.argtypes = [ ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t ]
+			lib.dpa_gather_u8.restype = None
+			lib.dpa_gather_u8.argtypes = [ ctypes.c_void_p, ctypes.c_size_t, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p ]
+			lib.dpa_gather_f32.restype = None
+			lib.dpa_gather_f32.argtypes = [ ctypes.c_void_p, ctypes.c_size_t, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p ]
+			lib.dpa_template_accumulate.restype = None
+			lib.dpa_template_accumulate.argtypes = [ ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_cholesky.restype = ctypes.c_bool
+			lib.dpa_cholesky.argtypes = [ ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_template_match.restype = None
+			lib.dpa_template_match.argtypes = [ ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpa_key_enumerate.restype = ctypes.c_int
+			lib.dpa_key_enumerate.argtypes = [ ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_uint64, ctypes.c_uint, ctypes.c_char_p, ctypes.POINTER(ctypes.c_uint64) ]
+			lib.dpa_key_rank_estimate.restype = None
+			lib.dpa_key_rank_estimate.argtypes = [ ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double) ]
+			cls._lib = lib
+		return cls._lib
+
+	@staticmethod
+	def _ptr(buf, typecode):
+		if buf is None:
+			return None
+		if buf.typecode != typecode:
+			raise TypeError("Expected array of type '%s', but got '%s'." % (typecode, buf.typecode))
+		return buf.buffer_info()[0]
+
+	@staticmethod
+	def zeros(typecode, length):
+		return array.array(typecode, bytes(array.array(typecode).itemsize * length))
+
+	@staticmethod
+	def default_thread_count():
+		return len(os.sched_getaffinity(0))
+
+	@classmethod
+	def accumulate_pairs(cls, x, x_length, y, y_length, x_mean, y_mean, classes, trace_count, combine, class_sums, pair_sums, pair_sqsums, class_counts, thread_count = None):
+		assert(len(x) >= trace_count * x_length)
+		assert(len(y) >= trace_count * y_length)
+		assert(len(classes) >= trace_count)
+		assert(len(class_sums) == cls.CLASS_COUNT * x_length * y_length)
+		assert(len(pair_sums) == len(pair_sqsums) == x_length * y_length)
+		assert(len(class_counts) == cls.CLASS_COUNT)
+		cls._library().dpa_accumulate_pairs(cls._ptr(x, "f"), x_length, cls._ptr(y, "f"), y_length, cls._ptr(x_mean, "f"), cls._ptr(y_mean, "f"), cls._ptr(classes, "B"), trace_count, combine, cls._ptr(class_sums, "d"), cls._ptr(pair_sums, "d"), cls._ptr(pair_sqsums, "d"), cls._ptr(class_counts, "I"), thread_count or cls.default_thread_count())
+
+	@classmethod
+	def accumulate_classes(cls, samples, column_count, classes, classes_per_trace, trace_count, class_sums, class_counts, thread_count = None):
+		assert(len(samples) >= trace_count * column_count)
+		assert(len(classes) >= trace_count * classes_per_trace)
+		assert(max(classes[:trace_count * classes_per_trace], default = 0) < len(class_counts))
+		assert(len(class_sums) == len(class_counts) * column_count)
+		cls._library().dpa_accumulate_classes(cls._ptr(samples, "f"), column_count, cls._ptr(classes, "I"), classes_per_trace, trace_count, cls._ptr(class_sums, "d"), cls._ptr(class_counts, "I"), thread_count or cls.default_thread_count())
+
+	@classmethod
+	def subset_ranks(cls, class_sums, class_counts, column_count, subsets, groups, correct_guess, thread_count = None):
+		flat_subsets = array.array("I")
+		subset_offsets = array.array("I", [ 0 ])
+		for subset in subsets:
+			flat_subsets.extend(subset)
+			subset_offsets.append(len(flat_subsets))
+		block_count = len(class_counts) // cls.CLASS_COUNT
+		assert(len(class_sums) == block_count * cls.CLASS_COUNT * column_count)
+		assert(max(flat_subsets, default = 0) < block_count)
+		assert(len(groups) == 256 * cls.CLASS_COUNT)
+		ranks = cls.zeros("I", len(subsets))
+		if not cls._library().dpa_subset_ranks(cls._ptr(class_sums, "d"), cls._ptr(class_counts, "I"), column_count, cls._ptr(flat_subsets, "I"), cls._ptr(subset_offsets, "I"), len(subsets), cls._ptr(groups, "b"), correct_guess, cls._ptr(ranks, "I"), thread_count or cls.default_thread_count()):
+			raise MemoryError("Unable to allocate memory for subset evaluation.")
+		return ranks
+
+	@classmethod
+	def class_projection(cls, class_sums, column_count, weights, guess_count, column_norm = None, thread_count = None):
+		assert(len(class_sums) == cls.CLASS_COUNT * column_count)
+		assert(len(weights) == cls.CLASS_COUNT * guess_count)
+		assert((column_norm is None) or (len(column_norm) == column_count))
+		max_abs = cls.zeros("d", guess_count)
+		argmax = cls.zeros("I", guess_count)
+		cls._library().dpa_class_projection(cls._ptr(class_sums, "d"), column_count, cls._ptr(weights, "d"), guess_count, cls._ptr(column_norm, "d"), cls._ptr(max_abs, "d"), cls._ptr(argmax, "I"), thread_count or cls.default_thread_count())
+		return (max_abs, argmax)
+
+	@classmethod
+	def class_combine(cls, class_sums, column_count, weights, guess_count, thread_count = None):
+		assert(len(class_sums) == cls.CLASS_COUNT * column_count)
+		assert(len(weights) == cls.CLASS_COUNT * guess_count)
+		combined = cls.zeros("d", guess_count * column_count)
+		cls._library().dpa_class_combine(cls._ptr(class_sums, "d"), column_count, cls._ptr(weights, "d"), guess_count, cls._ptr(combined, "d"), thread_count or cls.default_thread_count())
+		return combined
+
+	@classmethod
+	def add_sums(cls, target, source):
+		assert(len(target) == len(source))
+		cls._library().dpa_add_sums(cls._ptr(target, "d"), cls._ptr(source, "d"), len(target))
+
+	@classmethod
+	def gather(cls, samples, sample_stride, trace_count, columns = None, column_count = None):
+		# Compact float32 [trace_count][column_count] matrix of the given
+		# columns of uint8 ("B") or float32 ("f") samples
+		if columns is not None:
+			columns = array.array("I", columns)
+			column_count = len(columns)
+		assert(len(samples) >= trace_count * sample_stride)
+		assert(max(columns or [ column_count - 1 ]) < sample_stride)
+		points = cls.zeros("f", trace_count * column_count)
+		if samples.typecode == "B":
+			cls._library().dpa_gather_u8(cls._ptr(samples, "B"), sample_stride, trace_count, cls._ptr(columns, "I"), column_count, cls._ptr(points, "f"))
+		else:
+			cls._library().dpa_gather_f32(cls._ptr(samples, "f"), sample_stride, trace_count, cls._ptr(columns, "I"), column_count, cls._ptr(points, "f"))
+		return points
+
+	@classmethod
+	def template_accumulate(cls, points, point_count, classes, trace_count, class_sums, class_counts, scatter, thread_count = None):
+		assert(point_count <= cls.TEMPLATE_MAX_POINTS)
+		assert(len(points) >= trace_count * point_count)
+		assert(len(classes) >= trace_count)
+		assert(len(class_sums) == cls.CLASS_COUNT * point_count)
+		assert(len(class_counts) == cls.CLASS_COUNT)
+		assert(len(scatter) == point_count * point_count)
+		cls._library().dpa_template_accumulate(cls._ptr(points, "f"), point_count, cls._ptr(classes, "B"), trace_count, cls._ptr(class_sums, "d"), cls._ptr(class_counts, "Q"), cls._ptr(scatter, "d"), thread_count or cls.default_thread_count())
+
+	@classmethod
+	def cholesky(cls, matrix, n):
+		# Returns the lower triangular factor or None if the matrix is not
+		# positive definite
+		assert(len(matrix) == n * n)
+		factor = array.array("d", matrix)
+		if not cls._library().dpa_cholesky(cls._ptr(factor, "d"), n):
+			return None
+		return factor
+
+	@classmethod
+	def template_match(cls, points, point_count, plaintext_bytes, trace_count, means, cholesky, hypotheses, scores, thread_count = None):
+		assert(point_count <= cls.TEMPLATE_MAX_POINTS)
+		assert(len(points) >= trace_count * point_count)
+		assert(len(plaintext_bytes) >= trace_count)
+		assert(len(means) == cls.CLASS_COUNT * point_count)
+		assert(len(cholesky) == point_count * point_count)
+		assert(len(hypotheses) == 256 * 256)
+		assert(len(scores) == 256)
+		cls._library().dpa_template_match(cls._ptr(points, "f"), point_count, cls._ptr(plaintext_bytes, "B"), trace_count, cls._ptr(means, "d"), cls._ptr(cholesky, "d"), cls._ptr(hypotheses, "B"), cls._ptr(scores, "d"), thread_count or cls.default_thread_count())
+
+	@classmethod
+	def key_enumerate(cls, scores, plaintext, ciphertext, max_candidates, thread_count = None):
+		assert(len(scores) == 16 * 256)
+		assert(len(plaintext) == len(ciphertext) == 16)
+		key = ctypes.create_string_buffer(16)
+		rank = ctypes.c_uint64()
+		result = cls._library().dpa_key_enumerate(cls._ptr(scores, "d"), bytes(plaintext), bytes(ciphertext), max_candidates, thread_count or cls.default_thread_count(), key, ctypes.byref(rank))
+		if result == cls.KEY_ENUM_OUT_OF_MEMORY:
+			raise MemoryError("Unable to allocate memory for key enumeration.")
+		elif result != cls.KEY_FOUND:
+			return (None, None)
+		return (key.raw, rank.value)
+
+	@classmethod
+	def key_rank_estimate(cls, scores, key, bin_count = 1024):
+		assert(len(scores) == 16 * 256)
+		assert(len(key) == 16)
+		(lower, estimate, upper) = (ctypes.c_double(), ctypes.c_double(), ctypes.c_double())
+		cls._library().dpa_key_rank_estimate(cls._ptr(scores, "d"), bytes(key), bin_count, ctypes.byref(lower), ctypes.byref(estimate), ctypes.byref(upper))
+		return (lower.value, estimate.value, upper.value)
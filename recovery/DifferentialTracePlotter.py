@@ -0,0 +1,97 @@
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import os
+import array
+import subprocess
+
+# Renders differential traces through a single, long-lived gnuplot session.
+# All differential traces of one keybyte are stored as one binary float32
+# matrix (one row per key guess) which gnuplot then reads directly, both for
+# the per-guess plots and for the overview plot.
+class DifferentialTracePlotter():
+	def __init__(self, plot_directory, absolute_value, gnuplot_binary = "gnuplot"):
+		self._plot_directory = plot_directory
+		self._absolute_value = absolute_value
+		self._gnuplot_binary = gnuplot_binary
+		self._gnuplot = None
+		self._traces = { }
+
+	def _matrix_filename(self, i):
+		return "%s/K_%02d.bin" % (self._plot_directory, i)
+
+	def _png_filename(self, i, K = None):
+		if K is None:
+			return "%s/K_%02d.png" % (self._plot_directory, i)
+		else:
+			return "%s/K_%02d_%02x.png" % (self._plot_directory, i, K)
+
+	def _command(self, cmd):
+		if self._gnuplot is None:
+			os.makedirs(self._plot_directory, exist_ok = True)
+			self._gnuplot = subprocess.Popen([ self._gnuplot_binary ], stdin = subprocess.PIPE)
+			self._send("""
+				set terminal pngcairo size 1920,1080 enhanced
+				set yrange [ %f : %f ]
+			""" % (-self._absolute_value, self._absolute_value))
+		self._send(cmd)
+
+	def _send(self, cmd):
+		self._gnuplot.stdin.write(cmd.encode())
+		self._gnuplot.stdin.write(b"\n")
+
+	def add_trace(self, i, K, diff):
+		self._traces.setdefault(i, { })[K] = array.array("f", diff)
+
+	def _binary_source(self, filename, row, trace_length):
+		return "'%s' binary array=%d format='%%float32' skip=%d" % (filename, trace_length, row * trace_length * 4)
+
+	def render_keybyte(self, i, highlight_guesses = None):
+		traces = self._traces.pop(i, None)
+		if not traces:
+			return
+		highlight_guesses = set(highlight_guesses or [ ])
+
+		guesses = sorted(traces)
+		trace_length = min(len(trace) for trace in traces.values())
+		matrix_filename = self._matrix_filename(i)
+		os.makedirs(self._plot_directory, exist_ok = True)
+		with open(matrix_filename, "wb") as f:
+			for K in guesses:
+				traces[K][:trace_length].tofile(f)
+
+		for (row, K) in enumerate(guesses):
+			self._command("set output '%s'\nplot %s with lines title 'K %02x'" % (self._png_filename(i, K), self._binary_source(matrix_filename, row, trace_length), K))
+
+		plots = [ ]
+		for (row, K) in enumerate(guesses):
+			title = ("title 'K %02x'" % (K)) if (K in highlight_guesses) else "notitle"
+			plots.append("%s with lines %s" % (self._binary_source(matrix_filename, row, trace_length), title))
+		self._command("set output '%s'\nplot %s" % (self._png_filename(i), ", ".join(plots)))
+		self._command("set output")
+		self._gnuplot.stdin.flush()
+
+	def close(self):
+		if self._gnuplot is not None:
+			self._send("exit")
+			self._gnuplot.stdin.close()
+			self._gnuplot.wait()
+			self._gnuplot = None
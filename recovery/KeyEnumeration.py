@@ -0,0 +1,59 @@
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import math
+import array
+from DPAKernels import DPAKernels
+
+# Turns the per-guess scores of all 16 keybytes into a full-key search space:
+# scores are standardized per keybyte so that the sum over keybytes can serve
+# as the score of a full key. Keybytes (or single guesses) that were not
+# attacked are treated as least likely.
+class KeyEnumeration():
+	def __init__(self, keyguess_metrics):
+		self._scores = self._standardize(keyguess_metrics)
+
+	@staticmethod
+	def _standardize(keyguess_metrics):
+		scores = array.array("d")
+		for i in range(16):
+			metrics = keyguess_metrics.get(i, { })
+			if len(metrics) == 0:
+				scores.extend([ 0 ] * 256)
+				continue
+			mean = sum(metrics.values()) / len(metrics)
+			stddev = math.sqrt(sum((metric - mean) ** 2 for metric in metrics.values()) / len(metrics))
+			if stddev == 0:
+				stddev = 1
+			standardized = { K: (metric - mean) / stddev for (K, metric) in metrics.items() }
+			missing_score = min(standardized.values()) - 1
+			scores.extend(standardized.get(K, missing_score) for K in range(256))
+		return scores
+
+	@property
+	def scores(self):
+		return self._scores
+
+	def estimate_rank(self, key, bin_count = 1024):
+		return DPAKernels.key_rank_estimate(self._scores, key, bin_count = bin_count)
+
+	def enumerate(self, plaintext, ciphertext, max_candidates, thread_count = None):
+		return DPAKernels.key_enumerate(self._scores, plaintext, ciphertext, max_candidates, thread_count = thread_count)
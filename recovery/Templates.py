@@ -0,0 +1,224 @@
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+
+
+import os
+import sys
+import json
+import math
+import array
+from DPAKernels import DPAKernels
+
+# Profiled templates of the first round S-box output of all 16 keybytes. For
+# every keybyte, a handful of points of interest (POIs) is modeled as a
+# multivariate Gaussian per S-box output value that shares one pooled
+# covariance matrix with all other values. Like AttackState, only sufficient
+# statistics are kept (per-class sums and counts and the scatter matrix of the
+# POIs), so profiling streams over any number of traces in bounded memory and
+# profiles of several runs can be merged. The Gaussian model itself is derived
+# from the statistics on demand.
+class Templates():
+	_MAGIC = b"DPATMPL"
+	_VERSION = 1
+	_MAX_RIDGE_RETRIES = 12
+
+	def __init__(self, pois):
+		if len(pois) != 16:
+			raise ValueError("Expected points of interest for 16 keybytes, but got %d." % (len(pois)))
+		self._pois = [ list(byte_pois) for byte_pois in pois ]
+		self._trace_count = 0
+		self._sources = [ ]
+		self._class_sums = [ DPAKernels.zeros("d", DPAKernels.CLASS_COUNT * len(byte_pois)) for byte_pois in self._pois ]
+		self._class_counts = [ DPAKernels.zeros("Q", DPAKernels.CLASS_COUNT) for byte_pois in self._pois ]
+		self._scatter = [ DPAKernels.zeros("d", len(byte_pois) * len(byte_pois)) for byte_pois in self._pois ]
+		self._models = { }
+
+	@property
+	def pois(self):
+		return self._pois
+
+	@property
+	def trace_count(self):
+		return self._trace_count
+
+	@property
+	def sources(self):
+		# Where the profiling traces came from: seed and range of simulated
+		# traces or the digest of a tracefile
+		return self._sources
+
+	@property
+	def sample_count(self):
+		# Number of samples a trace needs to cover all POIs
+		return max(max(byte_pois) for byte_pois in self._pois) + 1
+
+	def class_counts(self, i):
+		return self._class_counts[i]
+
+	def accumulate(self, i, points, classes, trace_count, thread_count = None):
+		# points holds the POIs of keybyte i of every trace, classes the
+		# S-box output of keybyte i of every trace
+		DPAKernels.template_accumulate(points, len(self._pois[i]), classes, trace_count, self._class_sums[i], self._class_counts[i], self._scatter[i], thread_count = thread_count)
+		self._models.pop(i, None)
+
+	@staticmethod
+	def _overlap(source1, source2):
+		if ("tracefile" in source1) or ("tracefile" in source2):
+			return source1.get("tracefile") == source2.get("tracefile")
+		if source1["seed"] != source2["seed"]:
+			return False
+		return (source1["first"] < source2["first"] + source2["trace_count"]) and (source2["first"] < source1["first"] + source1["trace_count"])
+
+	def _add_sources(self, sources):
+		for source in sources:
+			for known in self._sources:
+				if self._overlap(source, known):
+					raise Exception("Templates were already profiled with some of these traces (%s); use a different seed for every profiling run." % (json.dumps(source)))
+			last = self._sources[-1] if (len(self._sources) > 0) else { }
+			if ("seed" in source) and (last.get("seed") == source["seed"]) and (last["first"] + last["trace_count"] == source["first"]):
+				# Consecutive batches of the same simulation
+				last["trace_count"] += source["trace_count"]
+			else:
+				self._sources.append(dict(source))
+
+	def add_traces(self, trace_count, source):
+		self._add_sources([ source ])
+		self._trace_count += trace_count
+
+	def merge(self, other):
+		if other.pois != self._pois:
+			raise Exception("Cannot merge templates with different points of interest.")
+		self._add_sources(other.sources)
+		for i in range(16):
+			DPAKernels.add_sums(self._class_sums[i], other._class_sums[i])
+			DPAKernels.add_sums(self._scatter[i], other._scatter[i])
+			for c in range(DPAKernels.CLASS_COUNT):
+				self._class_counts[i][c] += other._class_counts[i][c]
+		self._trace_count += other.trace_count
+		self._models = { }
+
+	def _pooled_covariance(self, i):
+		# Pooled within-class covariance: the scatter around the class means
+		# is the scatter around zero minus n_c * mu_c * mu_c^T of every class
+		d = len(self._pois[i])
+		class_sums = self._class_sums[i]
+		covariance = array.array("d", self._scatter[i])
+		populated = 0
+		for (c, count) in enumerate(self._class_counts[i]):
+			if count == 0:
+				continue
+			populated += 1
+			row = class_sums[c * d : (c + 1) * d]
+			for a in range(d):
+				factor = row[a] / count
+				for b in range(d):
+					covariance[(a * d) + b] -= factor * row[b]
+		dof = max(1, sum(self._class_counts[i]) - populated)
+		for index in range(len(covariance)):
+			covariance[index] /= dof
+		return covariance
+
+	def _compute_model(self, i, ridge):
+		d = len(self._pois[i])
+		class_counts = self._class_counts[i]
+		total_count = sum(class_counts)
+		if total_count == 0:
+			raise Exception("No profiling traces for keybyte %d." % (i))
+
+		# Classes that were never profiled are modeled by the overall mean,
+		# i.e., they are neither favored nor ruled out
+		class_sums = self._class_sums[i]
+		overall_mean = [ sum(class_sums[(c * d) + a] for c in range(DPAKernels.CLASS_COUNT)) / total_count for a in range(d) ]
+		means = array.array("d")
+		for (c, count) in enumerate(class_counts):
+			if count == 0:
+				means.extend(overall_mean)
+			else:
+				means.extend(value / count for value in class_sums[c * d : (c + 1) * d])
+
+		# Leakage of emulated traces is often a deterministic function of the
+		# class, which makes the covariance singular; a ridge relative to the
+		# average variance keeps it positive definite
+		covariance = self._pooled_covariance(i)
+		if not all(math.isfinite(value) for value in covariance):
+			raise Exception("Covariance of keybyte %d is not finite; the template statistics are corrupt." % (i))
+		scale = sum(covariance[(a * d) + a] for a in range(d)) / d
+		if scale <= 0:
+			scale = 1
+		for retry in range(self._MAX_RIDGE_RETRIES):
+			regularized = array.array("d", covariance)
+			for a in range(d):
+				regularized[(a * d) + a] += ridge * scale
+			cholesky = DPAKernels.cholesky(regularized, d)
+			if cholesky is not None:
+				return (means, cholesky)
+			ridge = max(ridge * 10, 1e-9)
+		raise Exception("Covariance of keybyte %d is not positive definite even with a ridge of %g." % (i, ridge / 10))
+
+	def model(self, i, ridge = 1e-3):
+		# Returns (means, cholesky): the 256 class means of the POIs and the
+		# lower triangular Cholesky factor of the pooled covariance
+		if i not in self._models:
+			self._models[i] = self._compute_model(i, ridge)
+		return self._models[i]
+
+	def write(self, filename):
+		header = {
+			"version":			self._VERSION,
+			"trace_count":		self._trace_count,
+			"pois":				self._pois,
+			"sources":			self._sources,
+		}
+		header = json.dumps(header).encode("utf-8")
+		tmp_filename = filename + ".tmp"
+		with open(tmp_filename, "wb") as f:
+			f.write(self._MAGIC)
+			f.write(len(header).to_bytes(4, byteorder = "little"))
+			f.write(header)
+			for i in range(16):
+				for data in [ self._class_counts[i], self._class_sums[i], self._scatter[i] ]:
+					if sys.byteorder != "little":
+						data = array.array(data.typecode, data)
+						data.byteswap()
+					data.tofile(f)
+		os.replace(tmp_filename, filename)
+
+	@classmethod
+	def read(cls, filename):
+		with open(filename, "rb") as f:
+			if f.read(len(cls._MAGIC)) != cls._MAGIC:
+				raise Exception("%s is not a template file." % (filename))
+			header_length = int.from_bytes(f.read(4), byteorder = "little")
+			header = json.loads(f.read(header_length).decode("utf-8"))
+			if header["version"] != cls._VERSION:
+				raise Exception("%s has unsupported template version %d." % (filename, header["version"]))
+			templates = cls(header["pois"])
+			templates._trace_count = header["trace_count"]
+			templates._sources = header.get("sources", [ ])
+			for i in range(16):
+				for data in [ templates._class_counts[i], templates._class_sums[i], templates._scatter[i] ]:
+					length = len(data)
+					del data[:]
+					data.fromfile(f, length)
+					if sys.byteorder != "little":
+						data.byteswap()
+		return templates
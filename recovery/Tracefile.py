@@ -21,9 +21,11 @@
 
 import re
 import json
+import array
 import base64
 import random
 import struct
+import hashlib
 from cryptography.hazmat.backends import default_backend
 import cryptography.hazmat.primitives.ciphers.modes
 import cryptography.hazmat.primitives.ciphers.algorithms
@@ -53,6 +55,32 @@ class Tracefile():
 	def correct_key(self):
 		return self._tracefile["meta"].get("key")
 
+	@property
+	def sample_map(self):
+		# Run-length encoded list of (sample_start, count, pc_start,
+		# pc_stride) if the simulator recorded it
+		return self._tracefile["meta"].get("sample_map")
+
+	def _select(self, max_traces = None, indices = None):
+		traces = self._tracefile["traces"]
+		if indices is not None:
+			return [ traces[index] for index in indices ]
+		return traces if (max_traces is None) else traces[:max_traces]
+
+	@staticmethod
+	def fingerprint(trace):
+		# 64 bit identifier of a single trace, derived from its plaintext and
+		# ciphertext
+		return int.from_bytes(hashlib.sha256(bytes(trace["plaintext"]) + bytes(trace["ciphertext"])).digest()[:8], byteorder = "little")
+
+	def digest(self, max_traces = None, indices = None):
+		# Identifies the same traces that sample_matrix() returns for these
+		# arguments, independently of their order
+		digest = hashlib.sha256()
+		for pair in sorted(bytes(trace["plaintext"]) + bytes(trace["ciphertext"]) for trace in self._select(max_traces, indices)):
+			digest.update(pair)
+		return digest.hexdigest()
+
 	@property
 	def format(self):
 		return self._tracefile["meta"].get("format", "uint8_t")
@@ -86,6 +114,22 @@ class Tracefile():
 		else:
 			raise Exception("Cannot validate unknown key type.")
 
+	def sample_matrix(self, start = 0, end = None, max_traces = None, indices = None):
+		# Returns the samples [start, end) of the first max_traces traces (or
+		# of the traces with the given indices) as one contiguous float32
+		# array with one row per trace, e.g., to be handed to native kernels.
+		# By default, all samples that all traces have in common are used.
+		traces = self._select(max_traces, indices)
+		if end is None:
+			end = min(len(trace["data"]) for trace in traces)
+		samples = array.array("f")
+		for trace in traces:
+			data = trace["data"][start : end]
+			if len(data) != end - start:
+				raise Exception("Sample range %d:%d exceeds trace length of %d samples." % (start, end, len(trace["data"])))
+			samples.extend(data)
+		return (samples, len(traces), end - start)
+
 	def __iter__(self):
 		return iter(self._tracefile["traces"])
 
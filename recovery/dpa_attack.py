@@ -20,12 +20,16 @@
 #
 #	Johannes Bauer <JohannesBauer@gmx.de>
 
+import os
 import sys
-import subprocess
-import threading
+import math
 import collections
-from FriendlyArgumentParser import FriendlyArgumentParser, baseint
+from FriendlyArgumentParser import FriendlyArgumentParser, baseint, baseint_unit
 from Tracefile import Tracefile
+from DifferentialTracePlotter import DifferentialTracePlotter
+from KeyEnumeration import KeyEnumeration
+from AttackState import AttackState
+from DPAKernels import DPAKernels
 
 class DPAAttack():
 	_AES_SBOX = [
@@ -49,11 +53,26 @@ class DPAAttack():
 
 	def __init__(self, args):
 		self._args = args
-		self._tracefile = Tracefile(self._args.tracefile)
+		self._tracefile = Tracefile(self._args.tracefile) if (self._args.tracefile is not None) else None
 		self._key = bytearray(16)
 		self._keyguess_metrics = collections.defaultdict(dict)
-		if self._args.validate_key:
-			self._tracefile.validate_key(self._tracefile.correct_key)
+		self._plotter = DifferentialTracePlotter("plots", self._args.plot_absolute_value) if self._args.create_plots else None
+		if self._tracefile is not None:
+			if self._args.validate_key:
+				self._tracefile.validate_key(self._tracefile.correct_key)
+			if self._args.correct_key is not None:
+				self._tracefile.correct_key = self._args.correct_key
+			if self._args.randomize:
+				self._tracefile.randomize()
+		if (self._args.checkpoint is not None) or (len(self._args.merge) > 0):
+			self._state = self._load_state()
+		elif self._tracefile is not None:
+			self._state = None
+		else:
+			raise Exception("Neither a tracefile nor a checkpoint to attack was given.")
+		self._correct_key = self._args.correct_key
+		if self._correct_key is None:
+			self._correct_key = self._tracefile.correct_key if (self._state is None) else self._state.key
 
 	@property
 	def key(self):
@@ -98,15 +117,23 @@ class DPAAttack():
 			moving_avg.append(bucketsum / len(bucket))
 		return moving_avg
 
-	def _plot_filename(self, i, K):
-		plotfile = "plots/K_%02d_%02x.txt" % (i, K)
-		return plotfile
-
-	def _execute(self, cmd, input = None):
-		def _thread_fnc():
-			return subprocess.check_output(cmd, input = input)
-		thread = threading.Thread(target = _thread_fnc)
-		thread.start()
+	def _load_state(self):
+		if (self._args.checkpoint is not None) and os.path.isfile(self._args.checkpoint):
+			state = AttackState.read(self._args.checkpoint)
+		else:
+			state = AttackState()
+		for filename in self._args.merge:
+			state.merge(AttackState.read(filename))
+		if self._tracefile is not None:
+			added = state.update(self._tracefile, max_traces = self._args.max_traces, thread_count = self._args.threads)
+			offered = min(self._tracefile.total_trace_count, self._args.max_traces or self._tracefile.total_trace_count)
+			if added < offered:
+				print("Skipped %d of %d traces that are already part of the attack state." % (offered - added, offered))
+		if self._args.checkpoint is not None:
+			state.write(self._args.checkpoint)
+		if state.trace_count == 0:
+			raise Exception("No traces to attack.")
+		return state
 
 	def _get_best_keyguess_metrics(self, i, n):
 		tuples = [ (metric, keyguess) for (keyguess, metric) in self._keyguess_metrics[i].items() ]
@@ -116,6 +143,36 @@ class DPAAttack():
 	def _get_best_keyguess_metric(self, i):
 		return self._get_best_keyguess_metrics(i, 1)[0]
 
+	def _estimate(self, P, K):
+		Q = P ^ K
+		Qpost = self._AES_SBOX[Q]
+		if self._args.model == "hdist":
+			return self._hweight((Q ^ Qpost) & self._args.bytemask)
+		elif self._args.model == "hweight":
+			return self._hweight(Qpost & self._args.bytemask)
+		else:
+			raise NotImplementedError(self._args.model)
+
+	def _report_failed_keyguess(self, i, K, low_count, high_count):
+		if self._correct_key is not None:
+			correct_str = " [correct %02x]" % (self._correct_key[i])
+		else:
+			correct_str = ""
+		print("Attacking keybyte %d with guess K = %02x%s failed: %3d low and %3d high candidates -- cannot compute differential trace; retry with more traces if the attack fails" % (i, K, correct_str, low_count, high_count))
+
+	def _report_keyguess(self, i, K, low_count, high_count, used_trace_count, total_trace_count, diff):
+		metric = max(diff)
+		self._keyguess_metrics[i][K] = metric
+		(best_metric, best_keyguess) = self._get_best_keyguess_metric(i)
+		if self._correct_key is not None:
+			correct_str = " [correct %02x]" % (self._correct_key[i])
+		else:
+			correct_str = ""
+		print("Attacking keybyte %d with guess K = %02x%s: %3d low and %3d high candidates; used %d traces of %d available (%.0f%%), grouped %d of those (%.0f%%); max diff %6.3f (best %02x %6.3f)" % (i, K, correct_str, low_count, high_count, used_trace_count, total_trace_count, used_trace_count / total_trace_count * 100, low_count + high_count, (low_count + high_count) / used_trace_count * 100, metric, best_keyguess, best_metric))
+
+		if self._plotter is not None:
+			self._plotter.add_trace(i, K, diff)
+
 	def _attack_keybyte_with_guess(self, i, K):
 		low_traces = [ ]
 		high_traces = [ ]
@@ -139,15 +196,7 @@ class DPAAttack():
 			# choose those traces for the grouping which have the most
 			# pronounced change in Hamming weight.
 
-			Q = P ^ K
-			Qpost = self._AES_SBOX[Q]
-			if self._args.model == "hdist":
-				estimate = self._hweight((Q ^ Qpost) & self._args.bytemask)
-			elif self._args.model == "hweight":
-				estimate = self._hweight(Qpost & self._args.bytemask)
-			else:
-				raise NotImplementedError(self._args.model)
-
+			estimate = self._estimate(P, K)
 			if estimate <= self._args.grouping_threshold[0]:
 				# Low candidate
 				low_traces.append(trace["data"])
@@ -156,11 +205,7 @@ class DPAAttack():
 				high_traces.append(trace["data"])
 
 		if (len(low_traces) == 0) or (len(high_traces) == 0):
-			if self._tracefile.correct_key is not None:
-				correct_str = " [correct %02x]" % (self._tracefile.correct_key[i])
-			else:
-				correct_str = ""
-			print("Attacking keybyte %d with guess K = %02x%s failed: %3d low and %3d high candidates -- cannot compute differential trace; retry with more traces if the attack fails" % (i, K, correct_str, len(low_traces), len(high_traces)))
+			self._report_failed_keyguess(i, K, len(low_traces), len(high_traces))
 		else:
 			if self._args.moving_average > 1:
 				low_traces = [ self._moving_average(trace, self._args.moving_average) for trace in low_traces ]
@@ -169,77 +214,103 @@ class DPAAttack():
 			avg_low = self._avg_trace(low_traces)
 			avg_high = self._avg_trace(high_traces)
 			diff = self._diff_trace(avg_high, avg_low)
-			metric = max(diff)
-			self._keyguess_metrics[i][K] = metric
-			(best_metric, best_keyguess) = self._get_best_keyguess_metric(i)
-			if self._tracefile.correct_key is not None:
-				correct_str = " [correct %02x]" % (self._tracefile.correct_key[i])
-			else:
-				correct_str = ""
-			print("Attacking keybyte %d with guess K = %02x%s: %3d low and %3d high candidates; used %d traces of %d available (%.0f%%), grouped %d of those (%.0f%%); max diff %6.3f (best %02x %6.3f)" % (i, K, correct_str, len(low_traces), len(high_traces), used_trace_count, self._tracefile.total_trace_count, used_trace_count / self._tracefile.total_trace_count * 100, len(low_traces) + len(high_traces), (len(low_traces) + len(high_traces)) / used_trace_count * 100, metric, best_keyguess, best_metric))
-
-			if self._args.create_plots:
-				plotfile = self._plot_filename(i, K)
-				with open(plotfile, "w") as f:
-					for value in diff:
-						print(value, file = f)
-
-				self._execute([ "gnuplot" ], input = ("""
-					set terminal pngcairo size 1920,1080 enhanced
-					set yrange [ %f : %f ]
-					set output '%s.png'
-					plot '%s' with lines
-				""" % (-self._args.plot_absolute_value, self._args.plot_absolute_value, plotfile, plotfile)).encode())
+			self._report_keyguess(i, K, len(low_traces), len(high_traces), used_trace_count, self._tracefile.total_trace_count, diff)
+
+	def _attack_keybyte_from_state(self, i, guesses):
+		# The mean of a group is the sum of its classes' sums divided by the
+		# number of its traces, so the differential traces of all guesses are
+		# computed from the accumulated state in one pass
+		class_counts = self._state.class_counts(i)
+		weights = DPAKernels.zeros("d", DPAKernels.CLASS_COUNT * len(guesses))
+		group_counts = [ ]
+		for (index, K) in enumerate(guesses):
+			groups = { }
+			for P in range(DPAKernels.CLASS_COUNT):
+				estimate = self._estimate(P, K)
+				if estimate <= self._args.grouping_threshold[0]:
+					groups[P] = -1
+				elif estimate >= self._args.grouping_threshold[1]:
+					groups[P] = 1
+			low_count = sum(class_counts[P] for (P, group) in groups.items() if group == -1)
+			high_count = sum(class_counts[P] for (P, group) in groups.items() if group == 1)
+			group_counts.append((low_count, high_count))
+			if (low_count > 0) and (high_count > 0):
+				for (P, group) in groups.items():
+					weights[(index * DPAKernels.CLASS_COUNT) + P] = (1 / high_count) if (group == 1) else (-1 / low_count)
+
+		sample_count = self._state.sample_count
+		diffs = DPAKernels.class_combine(self._state.class_sums(i), sample_count, weights, len(guesses), thread_count = self._args.threads)
+		for (index, (K, (low_count, high_count))) in enumerate(zip(guesses, group_counts)):
+			if (low_count == 0) or (high_count == 0):
+				self._report_failed_keyguess(i, K, low_count, high_count)
+				continue
+			diff = diffs[index * sample_count : (index + 1) * sample_count].tolist()
+			if self._args.moving_average > 1:
+				# The moving average is linear, so it can be applied to the
+				# difference instead of to every trace
+				diff = self._moving_average(diff, self._args.moving_average)
+			self._report_keyguess(i, K, low_count, high_count, self._state.trace_count, self._state.trace_count, diff)
 
 	def _attack_keybyte(self, i):
 		self._best_guess = None
 		guesses = list(range(256)) if (len(self._args.keybyte_guess) == 0) else self._args.keybyte_guess
-		for K in guesses:
-			self._attack_keybyte_with_guess(i, K)
+		if self._state is not None:
+			self._attack_keybyte_from_state(i, guesses)
+		else:
+			for K in guesses:
+				self._attack_keybyte_with_guess(i, K)
 		(metric, keybyte) = self._get_best_keyguess_metric(i)
 		self._key[i] = keybyte
 
-		if self._args.create_plots:
-			all_plot_pngfile = "plots/K_%02d.png" % (i)
+		if self._plotter is not None:
 			show_K = set(keybyte for (metric, keybyte) in self._get_best_keyguess_metrics(i, 5))
-
-			plot_filenames = [ ]
-			for K in guesses:
-				if K not in show_K:
-					plot_filenames.append((self._plot_filename(i, K), "notitle"))
-				else:
-					plot_filenames.append((self._plot_filename(i, K), "title 'K %02x'" % (K)))
-			plotcmd = ", ".join("'%s' with lines %s" % (filename, extra) for (filename, extra) in plot_filenames)
-			self._execute([ "gnuplot" ], input = ("""
-				set terminal pngcairo size 1920,1080 enhanced
-				set yrange [ %f : %f ]
-				set output '%s'
-				plot %s
-			""" % (-self._args.plot_absolute_value, self._args.plot_absolute_value, all_plot_pngfile, plotcmd)).encode())
-
+			self._plotter.render_keybyte(i, highlight_guesses = show_K)
 
 	def attack(self):
-		if self._args.correct_key is not None:
-			self._tracefile.correct_key = self._args.correct_key
-
-		if self._args.randomize:
-			self._tracefile.randomize()
 		if len(self._args.keybyte) == 0:
 			for i in range(16):
 				self._attack_keybyte(i)
 		else:
 			for i in self._args.keybyte:
 				self._attack_keybyte(i)
+		if self._plotter is not None:
+			self._plotter.close()
 
 	def print_results(self):
 		print("Recovered key after attack: %s" % (" ".join("%02x" % (x) for x in self._key)))
 		for i in self._keyguess_metrics:
 			(metric, keybyte) = self._get_best_keyguess_metric(i)
 			text = "   %2d [%02x] metric %6.3f" % (keybyte, self._key[i], metric)
-			if self._tracefile.correct_key is not None:
-				text += "  actual is [%02x] %s" % (self._tracefile.correct_key[i], [ "FAIL", "" ][self._key[i] == self._tracefile.correct_key[i]])
+			if self._correct_key is not None:
+				text += "  actual is [%02x] %s" % (self._correct_key[i], [ "FAIL", "" ][self._key[i] == self._correct_key[i]])
 			print(text)
 
+		if (self._args.enumerate is not None) or ((self._args.estimate_rank) and (self._correct_key is not None)):
+			self._print_enumeration_results()
+
+	def _print_enumeration_results(self):
+		enumeration = KeyEnumeration(self._keyguess_metrics)
+		if self._args.estimate_rank and (self._correct_key is not None):
+			(lower, estimate, upper) = enumeration.estimate_rank(self._correct_key)
+			print("Estimated rank of correct key: 2^%.1f (between 2^%.1f and 2^%.1f)" % (math.log2(estimate), math.log2(lower), math.log2(max(1, upper))))
+
+		if self._args.enumerate is not None:
+			# Every trace carries a known plaintext/ciphertext pair
+			if self._state is not None:
+				(plaintext, ciphertext) = self._state.known_pair
+			else:
+				trace = next(iter(self._tracefile))
+				(plaintext, ciphertext) = (trace["plaintext"], trace["ciphertext"])
+			try:
+				(key, rank) = enumeration.enumerate(plaintext, ciphertext, self._args.enumerate, thread_count = self._args.threads)
+			except MemoryError as e:
+				print("Key enumeration failed: %s" % (e))
+				return
+			if key is None:
+				print("Key enumeration: key not found among the %d most likely candidates." % (self._args.enumerate))
+			else:
+				print("Key enumeration: found key %s at rank %d (2^%.1f)" % (" ".join("%02x" % (x) for x in key), rank, math.log2(rank)))
+
 def _threshold(text):
 	text = text.split(":")
 	return (int(text[0]), int(text[1]))
@@ -257,10 +328,16 @@ parser.add_argument("-p", "--create-plots", action = "store_true", help = "Creat
 parser.add_argument("-P", "--plot-absolute-value", metavar = "value", type = float, default = 8.0, help = "For plots, gives the absolute value on the Y scale to use. Defaults to %(default).1f.")
 parser.add_argument("-n", "--max-traces", metavar = "count", type = int, help = "Use this number of traces at maximum for each keykyte estimation. By default, all traces in the tracefile are used.")
 parser.add_argument("-i", "--keybyte", metavar = "index", type = int, action = "append", default = [ ], help = "Attack keybyte at index i. Can be specified multiple times. By default, all keybytes are tried.")
+parser.add_argument("-e", "--enumerate", metavar = "count", type = baseint_unit, help = "After the attack, enumerate up to this many full key candidates in order of their score and verify them against a known plaintext/ciphertext pair. Accepts suffixes like k, M or Gi.")
+parser.add_argument("-R", "--estimate-rank", action = "store_true", help = "After the attack, estimate the rank of the correct key among all full keys. Requires the correct key to be known.")
+parser.add_argument("-c", "--checkpoint", metavar = "filename", help = "Keep the accumulated attack state in this file. If it exists, the traces of the tracefile are added to the state it contains and the attack runs on all traces accumulated so far; the updated state is written back.")
+parser.add_argument("-u", "--merge", metavar = "filename", action = "append", default = [ ], help = "Merge the attack state of this checkpoint, e.g., one created on a different machine. Can be specified multiple times.")
+parser.add_argument("-T", "--threads", metavar = "count", type = int, help = "Number of threads used for the native kernels and key enumeration. Defaults to the number of available CPUs.")
 parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
-parser.add_argument("tracefile", metavar = "tracefile_json", help = "The JSON source file which contains all collected/simulated traces")
-args = parser.parse_args(sys.argv[1:])
+parser.add_argument("tracefile", metavar = "tracefile_json", nargs = "?", help = "The JSON source file which contains all collected/simulated traces. May be omitted when attacking a checkpoint.")
 
-dpa = DPAAttack(args)
-dpa.attack()
-dpa.print_results()
+if __name__ == "__main__":
+	args = parser.parse_args(sys.argv[1:])
+	dpa = DPAAttack(args)
+	dpa.attack()
+	dpa.print_results()
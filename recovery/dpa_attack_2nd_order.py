@@ -0,0 +1,185 @@
+#!/usr/bin/python3
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import sys
+import math
+import array
+from FriendlyArgumentParser import FriendlyArgumentParser, baseint
+from Tracefile import Tracefile
+from DPAKernels import DPAKernels
+from dpa_attack import DPAAttack
+
+class SecondOrderAttack():
+	def __init__(self, args):
+		self._args = args
+		self._tracefile = Tracefile(self._args.tracefile)
+		if self._args.correct_key is not None:
+			self._tracefile.correct_key = self._args.correct_key
+		if self._args.randomize:
+			self._tracefile.randomize()
+		self._traces = list(self._tracefile)
+		if self._args.max_traces is not None:
+			self._traces = self._traces[:self._args.max_traces]
+		self._key = bytearray(16)
+		self._results = { }
+		(self._x, self._x_mean) = self._extract_window(self._args.window)
+		if self._args.second_window is None:
+			(self._y, self._y_mean) = (self._x, self._x_mean)
+			self._y_window = self._args.window
+		else:
+			(self._y, self._y_mean) = self._extract_window(self._args.second_window)
+			self._y_window = self._args.second_window
+
+	@property
+	def key(self):
+		return self._key
+
+	def _extract_window(self, window):
+		(start, end) = window
+		(samples, trace_count, length) = self._tracefile.sample_matrix(start, end, max_traces = len(self._traces))
+		mean = array.array("f", [ 0 ] * length)
+		for traceno in range(len(self._traces)):
+			for (index, value) in enumerate(samples[traceno * length : (traceno + 1) * length]):
+				mean[index] += value
+		for index in range(length):
+			mean[index] /= len(self._traces)
+		return (samples, mean)
+
+	def _hypothesis(self, P, K):
+		Q = P ^ K
+		Qpost = DPAAttack._AES_SBOX[Q]
+		if self._args.model == "hdist":
+			return DPAAttack._hweight((Q ^ Qpost) & self._args.bytemask)
+		elif self._args.model == "hweight":
+			return DPAAttack._hweight(Qpost & self._args.bytemask)
+		else:
+			raise NotImplementedError(self._args.model)
+
+	def _guess_weights(self, guesses, class_counts):
+		# The distinguisher of every guess is a linear combination of the
+		# per-class accumulators; for CPA the weights are the centered and
+		# normalized hypotheses, for DPA they average the low and high group.
+		trace_count = sum(class_counts)
+		weights = array.array("d")
+		for K in guesses:
+			hypotheses = [ self._hypothesis(P, K) for P in range(256) ]
+			if self._args.distinguisher == "cpa":
+				mean = sum(n * h for (n, h) in zip(class_counts, hypotheses)) / trace_count
+				norm = math.sqrt(sum(n * (h - mean) ** 2 for (n, h) in zip(class_counts, hypotheses)))
+				weights.extend(((h - mean) / norm) if ((n > 0) and (norm > 0)) else 0 for (n, h) in zip(class_counts, hypotheses))
+			else:
+				low_count = sum(n for (n, h) in zip(class_counts, hypotheses) if h <= self._args.grouping_threshold[0])
+				high_count = sum(n for (n, h) in zip(class_counts, hypotheses) if h >= self._args.grouping_threshold[1])
+				for h in hypotheses:
+					if (h <= self._args.grouping_threshold[0]) and (low_count > 0):
+						weights.append(-1 / low_count)
+					elif (h >= self._args.grouping_threshold[1]) and (high_count > 0):
+						weights.append(1 / high_count)
+					else:
+						weights.append(0)
+		return weights
+
+	def _attack_keybyte(self, i):
+		x_length = self._args.window[1] - self._args.window[0]
+		y_length = self._y_window[1] - self._y_window[0]
+		pair_count = x_length * y_length
+		if self._args.verbose >= 1:
+			print("Keybyte %d: combining %d x %d sample pairs of %d traces, accumulators use %.0f MiB" % (i, x_length, y_length, len(self._traces), (DPAKernels.CLASS_COUNT + 2) * pair_count * 8 / 1024 / 1024))
+
+		classes = array.array("B", (trace["plaintext"][i] for trace in self._traces))
+		class_sums = DPAKernels.zeros("d", DPAKernels.CLASS_COUNT * pair_count)
+		pair_sums = DPAKernels.zeros("d", pair_count)
+		pair_sqsums = DPAKernels.zeros("d", pair_count)
+		class_counts = DPAKernels.zeros("I", DPAKernels.CLASS_COUNT)
+		combine = DPAKernels.COMBINE_CENTERED_PRODUCT if (self._args.combine == "product") else DPAKernels.COMBINE_ABSOLUTE_DIFFERENCE
+		DPAKernels.accumulate_pairs(self._x, x_length, self._y, y_length, self._x_mean, self._y_mean, classes, len(self._traces), combine, class_sums, pair_sums, pair_sqsums, class_counts, thread_count = self._args.threads)
+
+		column_norm = None
+		if self._args.distinguisher == "cpa":
+			trace_count = len(self._traces)
+			column_norm = array.array("d", (math.sqrt(max(0, sqsum - (psum * psum / trace_count))) for (psum, sqsum) in zip(pair_sums, pair_sqsums)))
+
+		guesses = list(range(256)) if (len(self._args.keybyte_guess) == 0) else self._args.keybyte_guess
+		weights = self._guess_weights(guesses, class_counts)
+		(scores, argmax) = DPAKernels.class_projection(class_sums, pair_count, weights, len(guesses), column_norm = column_norm, thread_count = self._args.threads)
+
+		ranking = sorted(((score, K, pair) for (score, K, pair) in zip(scores, guesses, argmax)), reverse = True)
+		self._results[i] = ranking
+		self._key[i] = ranking[0][1]
+		if self._tracefile.correct_key is not None:
+			correct_str = " [correct %02x]" % (self._tracefile.correct_key[i])
+		else:
+			correct_str = ""
+		for (score, K, pair) in ranking[: max(1, self._args.show_best)]:
+			print("Keybyte %d%s: guess K = %02x score %8.5f at sample pair (%d, %d)" % (i, correct_str, K, score, self._args.window[0] + (pair // y_length), self._y_window[0] + (pair % y_length)))
+
+	def attack(self):
+		keybytes = range(16) if (len(self._args.keybyte) == 0) else self._args.keybyte
+		for i in keybytes:
+			self._attack_keybyte(i)
+
+	def print_results(self):
+		print("Recovered key after attack: %s" % (" ".join("%02x" % (x) for x in self._key)))
+		for (i, ranking) in sorted(self._results.items()):
+			(score, keybyte, pair) = ranking[0]
+			text = "   %2d [%02x] score %8.5f" % (i, keybyte, score)
+			if self._tracefile.correct_key is not None:
+				correct = self._tracefile.correct_key[i]
+				ranked_guesses = [ K for (score, K, pair) in ranking ]
+				rank = str(ranked_guesses.index(correct) + 1) if (correct in ranked_guesses) else "-"
+				text += "  actual is [%02x] rank %s %s" % (correct, rank, [ "FAIL", "" ][keybyte == correct])
+			print(text)
+
+def _threshold(text):
+	text = text.split(":")
+	return (int(text[0]), int(text[1]))
+
+def _window(text):
+	text = text.split(":")
+	(start, end) = (int(text[0]), int(text[1]))
+	if end <= start:
+		raise ValueError("window end must be after start")
+	return (start, end)
+
+parser = FriendlyArgumentParser(description = "Second-order DPA/CPA that combines sample pairs to attack masked implementations.")
+parser.add_argument("-w", "--window", metavar = "start:end", type = _window, required = True, help = "Window of samples that is combined with the second window. Mandatory.")
+parser.add_argument("-W", "--second-window", metavar = "start:end", type = _window, help = "Second window of samples. Every sample of the first window is combined with every sample of the second window. Defaults to the first window.")
+parser.add_argument("-c", "--combine", choices = [ "product", "absdiff" ], default = "product", help = "Function used to combine two samples. Can be %(choices)s, defaults to %(default)s.")
+parser.add_argument("-d", "--distinguisher", choices = [ "cpa", "dpa" ], default = "cpa", help = "Distinguisher used on the combined samples. Can be %(choices)s, defaults to %(default)s.")
+parser.add_argument("-m", "--model", choices = [ "hdist", "hweight" ], default = "hweight", help = "Choose the model to use as estimator. Can be %(choices)s, defaults to %(default)s.")
+parser.add_argument("-M", "--bytemask", metavar = "value", type = baseint, default = 255, help = "Mask the checked bits with this value. Default is 0x%(default)x.")
+parser.add_argument("-t", "--grouping-threshold", metavar = "low:high", type = _threshold, default = [ 3, 5 ], help = "Gives a lower and upper threshold for grouping when using DPA. Defaults to %(default)s.")
+parser.add_argument("-k", "--correct-key", metavar = "hex", type = bytes.fromhex, help = "Use this is the known correct key. Must be given in hex notation.")
+parser.add_argument("-g", "--keybyte-guess", metavar = "value", type = baseint, action = "append", default = [ ], help = "Try only these keybyte guesses. Can be specified more than once. By default, all values are tried.")
+parser.add_argument("-i", "--keybyte", metavar = "index", type = int, action = "append", default = [ ], help = "Attack keybyte at index i. Can be specified multiple times. By default, all keybytes are tried.")
+parser.add_argument("-r", "--randomize", action = "store_true", help = "Randomly shuffle traces before starting.")
+parser.add_argument("-n", "--max-traces", metavar = "count", type = int, help = "Use this number of traces at maximum. By default, all traces in the tracefile are used.")
+parser.add_argument("-b", "--show-best", metavar = "count", type = int, default = 1, help = "Show this many best guesses for every keybyte. Defaults to %(default)d.")
+parser.add_argument("-T", "--threads", metavar = "count", type = int, help = "Number of threads to use for the combining kernel. Defaults to the number of available CPUs.")
+parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
+parser.add_argument("tracefile", metavar = "tracefile_json", help = "The JSON source file which contains all collected/simulated traces")
+
+if __name__ == "__main__":
+	args = parser.parse_args(sys.argv[1:])
+	attack = SecondOrderAttack(args)
+	attack.attack()
+	attack.print_results()
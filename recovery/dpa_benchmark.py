@@ -0,0 +1,145 @@
+#!/usr/bin/python3
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import os
+import sys
+import json
+import time
+import base64
+import random
+import tempfile
+import contextlib
+from FriendlyArgumentParser import FriendlyArgumentParser
+from Tracefile import Tracefile
+import dpa_attack
+
+class DPABenchmark():
+	_KEY = bytes.fromhex("a617db75310a5f1cc7241bfcd9cb93e0")
+
+	def __init__(self, args):
+		self._args = args
+		self._results = [ ]
+
+	def _create_tracefile(self, filename, trace_count):
+		# Synthetic traces: Gaussian noise everywhere, and at a fixed sample
+		# per keybyte the Hamming distance of the first round S-box input and
+		# output is added -- exactly what the simulator leaks there as well.
+		prng = random.Random(self._args.seed)
+		tracefile = {
+			"meta": {
+				"algorithm":	"AES-128",
+				"mode":			"encrypt",
+				"key":			base64.b64encode(self._KEY).decode("ascii"),
+			},
+			"traces": [ ],
+		}
+		for traceno in range(trace_count):
+			plaintext = bytes(prng.getrandbits(8) for i in range(16))
+			ciphertext = Tracefile._aes128_enc(plaintext, self._KEY)
+			samples = [ prng.gauss(64, self._args.noise) for i in range(self._args.sample_count) ]
+			for i in range(16):
+				Q = plaintext[i] ^ self._KEY[i]
+				samples[(i + 1) * self._args.sample_count // 17] += dpa_attack.DPAAttack._hweight(Q ^ dpa_attack.DPAAttack._AES_SBOX[Q])
+			data = bytes(min(255, max(0, round(sample))) for sample in samples)
+			tracefile["traces"].append({
+				"plaintext": base64.b64encode(plaintext).decode("ascii"),
+				"ciphertext": base64.b64encode(ciphertext).decode("ascii"),
+				"data": base64.b64encode(data).decode("ascii"),
+			})
+		with open(filename, "w") as f:
+			json.dump(tracefile, f)
+
+	def _attack_args(self, tracefile, *extra_args):
+		return dpa_attack.parser.parse_args(list(extra_args) + [ tracefile ])
+
+	def _record(self, result):
+		self._results.append(result)
+		if self._args.verbose >= 1:
+			print(json.dumps(result), file = sys.stderr)
+
+	def _bench_guess_throughput(self, tracefile, trace_count):
+		dpa = dpa_attack.DPAAttack(self._attack_args(tracefile))
+		guesses = 0
+		with open(os.devnull, "w") as null, contextlib.redirect_stdout(null):
+			t0 = time.time()
+			while (guesses < 256) and ((guesses < 16) or (time.time() - t0 < self._args.min_runtime)):
+				dpa._attack_keybyte_with_guess(0, guesses)
+				guesses += 1
+			runtime = time.time() - t0
+		self._record({
+			"benchmark":		"attack_keybyte_guess",
+			"trace_count":		trace_count,
+			"sample_count":		self._args.sample_count,
+			"guesses":			guesses,
+			"runtime_secs":		runtime,
+			"guesses_per_sec":	guesses / runtime,
+		})
+
+	def _bench_traces_to_key(self, tracefile, trace_count):
+		t0 = time.time()
+		dpa = dpa_attack.DPAAttack(self._attack_args(tracefile))
+		t1 = time.time()
+		with open(os.devnull, "w") as null, contextlib.redirect_stdout(null):
+			dpa.attack()
+		t2 = time.time()
+		self._record({
+			"benchmark":			"traces_to_key",
+			"trace_count":			trace_count,
+			"sample_count":			self._args.sample_count,
+			"load_secs":			t1 - t0,
+			"attack_secs":			t2 - t1,
+			"runtime_secs":			t2 - t0,
+			"key_recovered":		bytes(dpa.key) == self._KEY,
+			"correct_keybytes":		sum(1 for (x, y) in zip(dpa.key, self._KEY) if x == y),
+		})
+
+	def run(self):
+		with tempfile.TemporaryDirectory(prefix = "dpa_benchmark_") as tmpdir:
+			for trace_count in self._args.trace_count:
+				tracefile = tmpdir + "/traces_%d.json" % (trace_count)
+				self._create_tracefile(tracefile, trace_count)
+				self._bench_guess_throughput(tracefile, trace_count)
+				if not self._args.no_end_to_end:
+					self._bench_traces_to_key(tracefile, trace_count)
+		return self._results
+
+parser = FriendlyArgumentParser(description = "Benchmark the DPA attack on a deterministic, synthetic set of traces.")
+parser.add_argument("-s", "--seed", metavar = "value", type = int, default = 1234, help = "Seed for the synthetic trace generator. Defaults to %(default)d.")
+parser.add_argument("-l", "--sample-count", metavar = "samples", type = int, default = 256, help = "Number of samples per synthetic trace. Defaults to %(default)d.")
+parser.add_argument("-N", "--noise", metavar = "sigma", type = float, default = 1.0, help = "Standard deviation of the Gaussian noise added to every sample. Defaults to %(default).1f.")
+parser.add_argument("-n", "--trace-count", metavar = "count", type = int, action = "append", default = [ ], help = "Dataset size to benchmark. Can be specified multiple times. Defaults to 250, 500 and 1000.")
+parser.add_argument("-t", "--min-runtime", metavar = "secs", type = float, default = 1.0, help = "Minimum time spent for measuring per-guess throughput. Defaults to %(default).1f secs.")
+parser.add_argument("-e", "--no-end-to-end", action = "store_true", help = "Do not run the full traces-to-key attack, only measure per-guess throughput.")
+parser.add_argument("-o", "--output", metavar = "filename", help = "Write JSON results to this file. By default, they are printed on stdout.")
+parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
+
+if __name__ == "__main__":
+	args = parser.parse_args(sys.argv[1:])
+	if len(args.trace_count) == 0:
+		args.trace_count = [ 250, 500, 1000 ]
+	results = DPABenchmark(args).run()
+	if args.output is None:
+		print(json.dumps(results, indent = 4))
+	else:
+		with open(args.output, "w") as f:
+			json.dump(results, f, indent = 4)
+			print(file = f)
@@ -0,0 +1,191 @@
+#!/usr/bin/python3
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import sys
+import json
+import math
+import array
+import random
+from FriendlyArgumentParser import FriendlyArgumentParser, baseint
+from Tracefile import Tracefile
+from DPAKernels import DPAKernels
+from dpa_attack import DPAAttack
+
+# Evaluates how many traces the DPA attack of dpa_attack.py needs. The traces
+# are split into blocks once and per-block, per-class partial sums are
+# accumulated for every keybyte; random subsets of blocks are then assembled
+# from those partial sums, so that hundreds of experiments cost about as much
+# as one attack pass.
+class DPAEvaluation():
+	def __init__(self, args):
+		self._args = args
+		self._tracefile = Tracefile(self._args.tracefile)
+		if self._args.correct_key is not None:
+			self._tracefile.correct_key = self._args.correct_key
+		if self._tracefile.correct_key is None:
+			raise Exception("Evaluation requires the correct key; it is not contained in the tracefile, specify it with --correct-key.")
+		if self._args.randomize:
+			self._tracefile.randomize()
+		trace_count = self._tracefile.total_trace_count
+		if self._args.max_traces is not None:
+			trace_count = min(trace_count, self._args.max_traces)
+		self._block_size = self._args.block_size or max(1, trace_count // 64)
+		self._block_count = trace_count // self._block_size
+		if self._block_count < 2:
+			raise Exception("Need at least two blocks of %d traces, but only %d traces are available." % (self._block_size, trace_count))
+		self._trace_count = self._block_count * self._block_size
+		(start, end) = self._args.window if (self._args.window is not None) else (0, None)
+		(self._samples, _, self._column_count) = self._tracefile.sample_matrix(start, end, max_traces = self._trace_count)
+		self._plaintexts = [ trace["plaintext"] for trace in list(self._tracefile)[:self._trace_count] ]
+		self._rng = random.Random(self._args.seed)
+		self._subsets = self._draw_subsets()
+		self._ranks = { }
+
+	def _subset_sizes(self):
+		# Sizes are given in traces and rounded up to full blocks
+		if len(self._args.subset_size) > 0:
+			sizes = [ min(self._block_count, max(1, (size + self._block_size - 1) // self._block_size)) for size in self._args.subset_size ]
+		else:
+			sizes = [ ]
+			size = 1
+			while size < self._block_count:
+				sizes.append(size)
+				size *= 2
+			sizes.append(self._block_count)
+		return sorted(set(sizes))
+
+	def _draw_subsets(self):
+		# All keybytes are evaluated on the same subsets, which makes the
+		# full-key success rate meaningful
+		subsets = [ ]
+		for size in self._subset_sizes():
+			for experiment in range(self._args.experiments):
+				subsets.append(self._rng.sample(range(self._block_count), size))
+		return subsets
+
+	def _groups(self):
+		groups = array.array("b", bytes(256 * DPAKernels.CLASS_COUNT))
+		for K in range(256):
+			for P in range(256):
+				Q = P ^ K
+				Qpost = DPAAttack._AES_SBOX[Q]
+				if self._args.model == "hdist":
+					estimate = DPAAttack._hweight((Q ^ Qpost) & self._args.bytemask)
+				elif self._args.model == "hweight":
+					estimate = DPAAttack._hweight(Qpost & self._args.bytemask)
+				else:
+					raise NotImplementedError(self._args.model)
+				if estimate <= self._args.grouping_threshold[0]:
+					groups[(K * DPAKernels.CLASS_COUNT) + P] = -1
+				elif estimate >= self._args.grouping_threshold[1]:
+					groups[(K * DPAKernels.CLASS_COUNT) + P] = 1
+		return groups
+
+	def _evaluate_keybyte(self, i, groups):
+		# Class of a trace is its block and the plaintext byte, i.e., the
+		# accumulators are [block][plaintext byte][sample]
+		classes = array.array("I", ((traceno // self._block_size) * DPAKernels.CLASS_COUNT + plaintext[i] for (traceno, plaintext) in enumerate(self._plaintexts)))
+		class_sums = DPAKernels.zeros("d", self._block_count * DPAKernels.CLASS_COUNT * self._column_count)
+		class_counts = DPAKernels.zeros("I", self._block_count * DPAKernels.CLASS_COUNT)
+		DPAKernels.accumulate_classes(self._samples, self._column_count, classes, 1, self._trace_count, class_sums, class_counts, thread_count = self._args.threads)
+		return DPAKernels.subset_ranks(class_sums, class_counts, self._column_count, self._subsets, groups, self._tracefile.correct_key[i], thread_count = self._args.threads)
+
+	def evaluate(self):
+		groups = self._groups()
+		keybytes = range(16) if (len(self._args.keybyte) == 0) else self._args.keybyte
+		for i in keybytes:
+			self._ranks[i] = self._evaluate_keybyte(i, groups)
+			if self._args.verbose >= 1:
+				print("Keybyte %d evaluated on %d subsets." % (i, len(self._subsets)), file = sys.stderr)
+
+	def results(self):
+		results = [ ]
+		experiments = self._args.experiments
+		for (index, size) in enumerate(self._subset_sizes()):
+			subset_range = range(index * experiments, (index + 1) * experiments)
+			per_byte = { }
+			for (i, ranks) in sorted(self._ranks.items()):
+				per_byte[i] = {
+					"success_rate":		sum(1 for s in subset_range if ranks[s] == 1) / experiments,
+					"guessing_entropy":	sum(math.log2(ranks[s]) for s in subset_range) / experiments,
+				}
+			full_key_successes = sum(1 for s in subset_range if all(ranks[s] == 1 for ranks in self._ranks.values()))
+			results.append({
+				"traces":					size * self._block_size,
+				"success_rate":				sum(result["success_rate"] for result in per_byte.values()) / len(per_byte),
+				"full_key_success_rate":	full_key_successes / experiments,
+				"guessing_entropy":			sum(result["guessing_entropy"] for result in per_byte.values()) / len(per_byte),
+				"keybytes":					per_byte,
+			})
+		return results
+
+	def print_results(self):
+		results = self.results()
+		print("%d traces in %d blocks of %d, %d experiments per size" % (self._trace_count, self._block_count, self._block_size, self._args.experiments))
+		print("  Traces  Success rate  Full key  Guessing entropy")
+		for result in results:
+			print("  %6d  %11.1f%%  %7.1f%%  %12.2f bits" % (result["traces"], result["success_rate"] * 100, result["full_key_success_rate"] * 100, result["guessing_entropy"]))
+		if self._args.output is not None:
+			with open(self._args.output, "w") as f:
+				json.dump({
+					"trace_count":		self._trace_count,
+					"block_size":		self._block_size,
+					"experiments":		self._args.experiments,
+					"seed":				self._args.seed,
+					"results":			results,
+				}, f, indent = 4)
+				f.write("\n")
+
+def _threshold(text):
+	text = text.split(":")
+	return (int(text[0]), int(text[1]))
+
+def _window(text):
+	text = text.split(":")
+	(start, end) = (int(text[0]), int(text[1]))
+	if end <= start:
+		raise ValueError("window end must be after start")
+	return (start, end)
+
+parser = FriendlyArgumentParser(description = "Evaluate success rate and guessing entropy of the DPA attack over the number of traces.")
+parser.add_argument("-w", "--window", metavar = "start:end", type = _window, help = "Only consider this window of samples. By default, all samples are used.")
+parser.add_argument("-b", "--block-size", metavar = "traces", type = int, help = "Number of traces per block. Subset sizes are multiples of this. Defaults to 1/64th of the traces.")
+parser.add_argument("-s", "--subset-size", metavar = "traces", type = int, action = "append", default = [ ], help = "Evaluate subsets of this many traces. Can be specified multiple times. By default, sizes double from one block up to all traces.")
+parser.add_argument("-x", "--experiments", metavar = "count", type = int, default = 100, help = "Number of random subsets drawn for every size. Defaults to %(default)d.")
+parser.add_argument("-S", "--seed", metavar = "value", type = int, default = 0, help = "Seed for drawing the random subsets. Defaults to %(default)d.")
+parser.add_argument("-m", "--model", choices = [ "hdist", "hweight" ], default = "hdist", help = "Choose the model to use as estimator. Can be %(choices)s, defaults to %(default)s.")
+parser.add_argument("-M", "--bytemask", metavar = "value", type = baseint, default = 255, help = "Mask the checked bits with this value. Default is 0x%(default)x.")
+parser.add_argument("-t", "--grouping-threshold", metavar = "low:high", type = _threshold, default = [ 1, 7 ], help = "Gives a lower and upper threshold for grouping. Defaults to %(default)s.")
+parser.add_argument("-k", "--correct-key", metavar = "hex", type = bytes.fromhex, help = "Use this is the known correct key. Must be given in hex notation.")
+parser.add_argument("-i", "--keybyte", metavar = "index", type = int, action = "append", default = [ ], help = "Evaluate keybyte at index i. Can be specified multiple times. By default, all keybytes are evaluated.")
+parser.add_argument("-r", "--randomize", action = "store_true", help = "Randomly shuffle traces before splitting them into blocks.")
+parser.add_argument("-n", "--max-traces", metavar = "count", type = int, help = "Use this number of traces at maximum. By default, all traces in the tracefile are used.")
+parser.add_argument("-o", "--output", metavar = "filename", help = "Also write the results as JSON to this file.")
+parser.add_argument("-T", "--threads", metavar = "count", type = int, help = "Number of threads to use. Defaults to the number of available CPUs.")
+parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
+parser.add_argument("tracefile", metavar = "tracefile_json", help = "The JSON source file which contains all collected/simulated traces")
+
+if __name__ == "__main__":
+	args = parser.parse_args(sys.argv[1:])
+	evaluation = DPAEvaluation(args)
+	evaluation.evaluate()
+	evaluation.print_results()
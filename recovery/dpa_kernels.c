@@ -0,0 +1,464 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dpa_threads.h"
+#include "dpa_kernels.h"
+
+/* Tile edge lengths for the sample pair kernel; a tile covers
+ * PAIR_TILE_X * PAIR_TILE_Y pairs so that the accumulator rows of all 256
+ * classes for one tile (2 MiB) stay cache resident while all traces are
+ * streamed over it. */
+#define PAIR_TILE_X				16
+#define PAIR_TILE_Y				64
+#define PROJECTION_CHUNK		256
+
+struct accumulate_pairs_ctx_t {
+	const float *x, *y;
+	unsigned int x_length, y_length;
+	const float *x_mean, *y_mean;
+	const uint8_t *classes;
+	unsigned int trace_count;
+	enum dpa_combine_t combine;
+	double *class_sums;
+	double *pair_sums;
+	double *pair_sqsums;
+};
+
+static void accumulate_pairs_tile(const struct accumulate_pairs_ctx_t *ctx, unsigned int x0, unsigned int x1, unsigned int y0, unsigned int y1) {
+	const unsigned int pair_count = ctx->x_length * ctx->y_length;
+	const unsigned int tile_y = y1 - y0;
+	float yv[PAIR_TILE_Y];
+
+	for (unsigned int t = 0; t < ctx->trace_count; t++) {
+		const float *xrow = ctx->x + ((size_t)t * ctx->x_length);
+		const float *yrow = ctx->y + ((size_t)t * ctx->y_length);
+		double *class_sums = ctx->class_sums + ((size_t)ctx->classes[t] * pair_count);
+
+		if (ctx->combine == DPA_COMBINE_CENTERED_PRODUCT) {
+			for (unsigned int j = 0; j < tile_y; j++) {
+				yv[j] = yrow[y0 + j] - ctx->y_mean[y0 + j];
+			}
+		} else {
+			memcpy(yv, yrow + y0, tile_y * sizeof(float));
+		}
+
+		for (unsigned int i = x0; i < x1; i++) {
+			const unsigned int offset = (i * ctx->y_length) + y0;
+			double *class_row = class_sums + offset;
+			double *sum_row = ctx->pair_sums + offset;
+			double *sqsum_row = ctx->pair_sqsums + offset;
+			if (ctx->combine == DPA_COMBINE_CENTERED_PRODUCT) {
+				const float xv = xrow[i] - ctx->x_mean[i];
+				for (unsigned int j = 0; j < tile_y; j++) {
+					const double value = xv * yv[j];
+					class_row[j] += value;
+					sum_row[j] += value;
+					sqsum_row[j] += value * value;
+				}
+			} else {
+				const float xv = xrow[i];
+				for (unsigned int j = 0; j < tile_y; j++) {
+					const double value = fabsf(xv - yv[j]);
+					class_row[j] += value;
+					sum_row[j] += value;
+					sqsum_row[j] += value * value;
+				}
+			}
+		}
+	}
+}
+
+static void accumulate_pairs_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	const struct accumulate_pairs_ctx_t *ctx = (const struct accumulate_pairs_ctx_t*)vctx;
+	const unsigned int tiles_x = (ctx->x_length + PAIR_TILE_X - 1) / PAIR_TILE_X;
+	const unsigned int tiles_y = (ctx->y_length + PAIR_TILE_Y - 1) / PAIR_TILE_Y;
+
+	/* Every tile owns a disjoint part of all accumulators, so threads never
+	 * need to synchronize */
+	for (unsigned int tile = thread_index; tile < tiles_x * tiles_y; tile += thread_count) {
+		const unsigned int x0 = (tile / tiles_y) * PAIR_TILE_X;
+		const unsigned int y0 = (tile % tiles_y) * PAIR_TILE_Y;
+		const unsigned int x1 = (x0 + PAIR_TILE_X < ctx->x_length) ? (x0 + PAIR_TILE_X) : ctx->x_length;
+		const unsigned int y1 = (y0 + PAIR_TILE_Y < ctx->y_length) ? (y0 + PAIR_TILE_Y) : ctx->y_length;
+		accumulate_pairs_tile(ctx, x0, x1, y0, y1);
+	}
+}
+
+/* Combines every sample of window x with every sample of window y (both given
+ * as trace_count rows) and adds the combined values to the accumulators:
+ * class_sums is [DPA_CLASS_COUNT][x_length * y_length] and indexed by the
+ * class of each trace, pair_sums and pair_sqsums hold sum and sum of squares
+ * over all traces. Accumulators are only ever added to, so traces can be fed
+ * in arbitrary batches. Means are only required for the centered product. */
+void dpa_accumulate_pairs(const float *x, unsigned int x_length, const float *y, unsigned int y_length, const float *x_mean, const float *y_mean, const uint8_t *classes, unsigned int trace_count, enum dpa_combine_t combine, double *class_sums, double *pair_sums, double *pair_sqsums, uint32_t *class_counts, unsigned int thread_count) {
+	struct accumulate_pairs_ctx_t ctx = {
+		.x = x,
+		.y = y,
+		.x_length = x_length,
+		.y_length = y_length,
+		.x_mean = x_mean,
+		.y_mean = y_mean,
+		.classes = classes,
+		.trace_count = trace_count,
+		.combine = combine,
+		.class_sums = class_sums,
+		.pair_sums = pair_sums,
+		.pair_sqsums = pair_sqsums,
+	};
+	dpa_run_threaded(accumulate_pairs_thread, &ctx, thread_count);
+	for (unsigned int t = 0; t < trace_count; t++) {
+		class_counts[classes[t]]++;
+	}
+}
+
+struct accumulate_classes_ctx_t {
+	const float *samples;
+	unsigned int column_count;
+	const uint32_t *classes;
+	unsigned int classes_per_trace;
+	unsigned int trace_count;
+	double *class_sums;
+};
+
+static void accumulate_classes_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	const struct accumulate_classes_ctx_t *ctx = (const struct accumulate_classes_ctx_t*)vctx;
+
+	/* Threads own disjoint column ranges of all accumulators */
+	const unsigned int c0 = (unsigned int)(((uint64_t)ctx->column_count * thread_index) / thread_count);
+	const unsigned int c1 = (unsigned int)(((uint64_t)ctx->column_count * (thread_index + 1)) / thread_count);
+	for (unsigned int t = 0; t < ctx->trace_count; t++) {
+		const float *row = ctx->samples + ((size_t)t * ctx->column_count);
+		for (unsigned int k = 0; k < ctx->classes_per_trace; k++) {
+			double *class_row = ctx->class_sums + ((size_t)ctx->classes[((size_t)t * ctx->classes_per_trace) + k] * ctx->column_count);
+			for (unsigned int c = c0; c < c1; c++) {
+				class_row[c] += row[c];
+			}
+		}
+	}
+}
+
+/* Adds every trace (a row of column_count samples) to the sums of each of its
+ * classes_per_trace classes, e.g., one class per keybyte given by the value
+ * of that plaintext byte. class_sums is [number of classes][column_count]. */
+void dpa_accumulate_classes(const float *samples, unsigned int column_count, const uint32_t *classes, unsigned int classes_per_trace, unsigned int trace_count, double *class_sums, uint32_t *class_counts, unsigned int thread_count) {
+	struct accumulate_classes_ctx_t ctx = {
+		.samples = samples,
+		.column_count = column_count,
+		.classes = classes,
+		.classes_per_trace = classes_per_trace,
+		.trace_count = trace_count,
+		.class_sums = class_sums,
+	};
+	if (thread_count > column_count) {
+		thread_count = column_count;
+	}
+	dpa_run_threaded(accumulate_classes_thread, &ctx, thread_count);
+	for (size_t i = 0; i < (size_t)trace_count * classes_per_trace; i++) {
+		class_counts[classes[i]]++;
+	}
+}
+
+struct subset_ranks_ctx_t {
+	const double *class_sums;
+	const uint32_t *class_counts;
+	unsigned int column_count;
+	const uint32_t *subsets;
+	const uint32_t *subset_offsets;
+	unsigned int subset_count;
+	const int8_t *groups;
+	uint8_t correct_guess;
+	uint32_t *ranks;
+};
+
+/* Difference of means of the high and the low group as the DPA attack computes
+ * it, i.e., the signed maximum over all samples */
+static double subset_dom_metric(const double *sums, const uint32_t *counts, unsigned int column_count, const int8_t *groups, double *low, double *high) {
+	uint64_t low_count = 0, high_count = 0;
+	memset(low, 0, column_count * sizeof(double));
+	memset(high, 0, column_count * sizeof(double));
+	for (unsigned int c = 0; c < DPA_CLASS_COUNT; c++) {
+		if ((groups[c] == 0) || (counts[c] == 0)) {
+			continue;
+		}
+		double *target = (groups[c] < 0) ? low : high;
+		const double *row = sums + ((size_t)c * column_count);
+		for (unsigned int k = 0; k < column_count; k++) {
+			target[k] += row[k];
+		}
+		if (groups[c] < 0) {
+			low_count += counts[c];
+		} else {
+			high_count += counts[c];
+		}
+	}
+	if ((low_count == 0) || (high_count == 0)) {
+		return -INFINITY;
+	}
+	double metric = -INFINITY;
+	for (unsigned int k = 0; k < column_count; k++) {
+		const double diff = (high[k] / high_count) - (low[k] / low_count);
+		if (diff > metric) {
+			metric = diff;
+		}
+	}
+	return metric;
+}
+
+static void subset_ranks_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	const struct subset_ranks_ctx_t *ctx = (const struct subset_ranks_ctx_t*)vctx;
+	const size_t block_size = (size_t)DPA_CLASS_COUNT * ctx->column_count;
+	double *sums = malloc(sizeof(double) * (block_size + (2 * ctx->column_count)));
+	if (!sums) {
+		/* A rank of zero marks the subsets of this thread as failed */
+		for (unsigned int s = thread_index; s < ctx->subset_count; s += thread_count) {
+			ctx->ranks[s] = 0;
+		}
+		return;
+	}
+	double *low = sums + block_size;
+	double *high = low + ctx->column_count;
+	uint32_t counts[DPA_CLASS_COUNT];
+	double metrics[256];
+
+	for (unsigned int s = thread_index; s < ctx->subset_count; s += thread_count) {
+		/* Assemble the subset from the per-block partial sums */
+		memset(sums, 0, sizeof(double) * block_size);
+		memset(counts, 0, sizeof(counts));
+		for (uint32_t i = ctx->subset_offsets[s]; i < ctx->subset_offsets[s + 1]; i++) {
+			const uint32_t block = ctx->subsets[i];
+			const double *block_sums = ctx->class_sums + (block * block_size);
+			const uint32_t *block_counts = ctx->class_counts + (block * DPA_CLASS_COUNT);
+			for (size_t k = 0; k < block_size; k++) {
+				sums[k] += block_sums[k];
+			}
+			for (unsigned int c = 0; c < DPA_CLASS_COUNT; c++) {
+				counts[c] += block_counts[c];
+			}
+		}
+
+		for (unsigned int guess = 0; guess < 256; guess++) {
+			metrics[guess] = subset_dom_metric(sums, counts, ctx->column_count, ctx->groups + (guess * DPA_CLASS_COUNT), low, high);
+		}
+		/* The attack never picks a guess without a differential trace, so an
+		 * undefined correct guess gets the worst rank; ties are counted
+		 * against the correct guess */
+		uint32_t rank = 256;
+		if (metrics[ctx->correct_guess] != -INFINITY) {
+			rank = 1;
+			for (unsigned int guess = 0; guess < 256; guess++) {
+				if ((guess != ctx->correct_guess) && (metrics[guess] >= metrics[ctx->correct_guess])) {
+					rank++;
+				}
+			}
+		}
+		ctx->ranks[s] = rank;
+	}
+	free(sums);
+}
+
+/* Evaluates a DPA attack on many subsets of the traces at once. The traces are
+ * split into blocks for which the per-class sums (class_sums is
+ * [block][DPA_CLASS_COUNT][column_count], class_counts is
+ * [block][DPA_CLASS_COUNT]) are precomputed; every subset is a list of blocks
+ * (subsets[subset_offsets[s] .. subset_offsets[s + 1]]). groups is
+ * [256 guesses][DPA_CLASS_COUNT] and assigns each class to the low (-1) or
+ * high (1) group or to neither (0). Reports the rank of the correct guess for
+ * each subset; returns false if memory could not be allocated. */
+bool dpa_subset_ranks(const double *class_sums, const uint32_t *class_counts, unsigned int column_count, const uint32_t *subsets, const uint32_t *subset_offsets, unsigned int subset_count, const int8_t *groups, uint8_t correct_guess, uint32_t *ranks, unsigned int thread_count) {
+	struct subset_ranks_ctx_t ctx = {
+		.class_sums = class_sums,
+		.class_counts = class_counts,
+		.column_count = column_count,
+		.subsets = subsets,
+		.subset_offsets = subset_offsets,
+		.subset_count = subset_count,
+		.groups = groups,
+		.correct_guess = correct_guess,
+		.ranks = ranks,
+	};
+	dpa_run_threaded(subset_ranks_thread, &ctx, thread_count);
+	for (unsigned int s = 0; s < subset_count; s++) {
+		if (ranks[s] == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct class_projection_ctx_t {
+	const double *class_sums;
+	unsigned int column_count;
+	const double *weights;
+	unsigned int guess_count;
+	const double *column_norm;
+	double *max_abs;
+	uint32_t *argmax;
+};
+
+static void class_projection_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	const struct class_projection_ctx_t *ctx = (const struct class_projection_ctx_t*)vctx;
+	double *max_abs = ctx->max_abs + ((size_t)thread_index * ctx->guess_count);
+	uint32_t *argmax = ctx->argmax + ((size_t)thread_index * ctx->guess_count);
+	double projection[PROJECTION_CHUNK];
+
+	for (unsigned int g = 0; g < ctx->guess_count; g++) {
+		max_abs[g] = -1;
+		argmax[g] = 0;
+	}
+
+	const unsigned int chunks = (ctx->column_count + PROJECTION_CHUNK - 1) / PROJECTION_CHUNK;
+	for (unsigned int chunk = thread_index; chunk < chunks; chunk += thread_count) {
+		const unsigned int c0 = chunk * PROJECTION_CHUNK;
+		const unsigned int width = (c0 + PROJECTION_CHUNK < ctx->column_count) ? PROJECTION_CHUNK : (ctx->column_count - c0);
+		for (unsigned int g = 0; g < ctx->guess_count; g++) {
+			const double *weights = ctx->weights + ((size_t)g * DPA_CLASS_COUNT);
+			memset(projection, 0, width * sizeof(double));
+			for (unsigned int c = 0; c < DPA_CLASS_COUNT; c++) {
+				const double w = weights[c];
+				if (w == 0) {
+					continue;
+				}
+				const double *row = ctx->class_sums + ((size_t)c * ctx->column_count) + c0;
+				for (unsigned int k = 0; k < width; k++) {
+					projection[k] += w * row[k];
+				}
+			}
+			for (unsigned int k = 0; k < width; k++) {
+				double value = fabs(projection[k]);
+				if (ctx->column_norm) {
+					const double norm = ctx->column_norm[c0 + k];
+					value = (norm > 0) ? (value / norm) : 0;
+				}
+				if (value > max_abs[g]) {
+					max_abs[g] = value;
+					argmax[g] = c0 + k;
+				}
+			}
+		}
+	}
+}
+
+/* For every guess g, computes the projection sum_c weights[g][c] *
+ * class_sums[c][k] for all columns k (optionally divided by column_norm[k])
+ * and reports the maximum absolute value and the column at which it occurs.
+ * Difference of means as well as correlation can be expressed this way by
+ * choosing the weights accordingly. */
+void dpa_class_projection(const double *class_sums, unsigned int column_count, const double *weights, unsigned int guess_count, const double *column_norm, double *max_abs, uint32_t *argmax, unsigned int thread_count) {
+	if (thread_count < 1) {
+		thread_count = 1;
+	} else if (thread_count > DPA_MAX_THREADS) {
+		thread_count = DPA_MAX_THREADS;
+	}
+	double *thread_max_abs = malloc(sizeof(double) * guess_count * thread_count);
+	uint32_t *thread_argmax = malloc(sizeof(uint32_t) * guess_count * thread_count);
+	if (!thread_max_abs || !thread_argmax) {
+		free(thread_max_abs);
+		free(thread_argmax);
+		thread_count = 1;
+		thread_max_abs = max_abs;
+		thread_argmax = argmax;
+	}
+
+	struct class_projection_ctx_t ctx = {
+		.class_sums = class_sums,
+		.column_count = column_count,
+		.weights = weights,
+		.guess_count = guess_count,
+		.column_norm = column_norm,
+		.max_abs = thread_max_abs,
+		.argmax = thread_argmax,
+	};
+	dpa_run_threaded(class_projection_thread, &ctx, thread_count);
+
+	if (thread_max_abs != max_abs) {
+		for (unsigned int g = 0; g < guess_count; g++) {
+			max_abs[g] = -1;
+			argmax[g] = 0;
+			for (unsigned int t = 0; t < thread_count; t++) {
+				const unsigned int index = (t * guess_count) + g;
+				if (thread_max_abs[index] > max_abs[g]) {
+					max_abs[g] = thread_max_abs[index];
+					argmax[g] = thread_argmax[index];
+				}
+			}
+		}
+		free(thread_max_abs);
+		free(thread_argmax);
+	}
+}
+
+struct class_combine_ctx_t {
+	const double *class_sums;
+	unsigned int column_count;
+	const double *weights;
+	unsigned int guess_count;
+	double *combined;
+};
+
+static void class_combine_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	const struct class_combine_ctx_t *ctx = (const struct class_combine_ctx_t*)vctx;
+	for (unsigned int g = thread_index; g < ctx->guess_count; g += thread_count) {
+		const double *weights = ctx->weights + ((size_t)g * DPA_CLASS_COUNT);
+		double *combined = ctx->combined + ((size_t)g * ctx->column_count);
+		memset(combined, 0, ctx->column_count * sizeof(double));
+		for (unsigned int c = 0; c < DPA_CLASS_COUNT; c++) {
+			const double w = weights[c];
+			if (w == 0) {
+				continue;
+			}
+			const double *row = ctx->class_sums + ((size_t)c * ctx->column_count);
+			for (unsigned int k = 0; k < ctx->column_count; k++) {
+				combined[k] += w * row[k];
+			}
+		}
+	}
+}
+
+/* Like dpa_class_projection(), but returns the full projected traces
+ * combined[g][k] = sum_c weights[g][c] * class_sums[c][k] instead of only
+ * their maximum, e.g., to plot differential traces. */
+void dpa_class_combine(const double *class_sums, unsigned int column_count, const double *weights, unsigned int guess_count, double *combined, unsigned int thread_count) {
+	struct class_combine_ctx_t ctx = {
+		.class_sums = class_sums,
+		.column_count = column_count,
+		.weights = weights,
+		.guess_count = guess_count,
+		.combined = combined,
+	};
+	if (thread_count > guess_count) {
+		thread_count = guess_count;
+	}
+	dpa_run_threaded(class_combine_thread, &ctx, thread_count);
+}
+
+/* Element-wise target += source, e.g., to merge the accumulated class sums of
+ * two attack states. */
+void dpa_add_sums(double *target, const double *source, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		target[i] += source[i];
+	}
+}
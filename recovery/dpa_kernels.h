@@ -0,0 +1,47 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#ifndef __DPA_KERNELS_H__
+#define __DPA_KERNELS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DPA_CLASS_COUNT			256
+
+enum dpa_combine_t {
+	DPA_COMBINE_CENTERED_PRODUCT = 0,
+	DPA_COMBINE_ABSOLUTE_DIFFERENCE = 1,
+};
+
+/*************** AUTO GENERATED SECTION FOLLOWS ***************/
+void dpa_accumulate_pairs(const float *x, unsigned int x_length, const float *y, unsigned int y_length, const float *x_mean, const float *y_mean, const uint8_t *classes, unsigned int trace_count, enum dpa_combine_t combine, double *class_sums, double *pair_sums, double *pair_sqsums, uint32_t *class_counts, unsigned int thread_count);
+void dpa_accumulate_classes(const float *samples, unsigned int column_count, const uint32_t *classes, unsigned int classes_per_trace, unsigned int trace_count, double *class_sums, uint32_t *class_counts, unsigned int thread_count);
+bool dpa_subset_ranks(const double *class_sums, const uint32_t *class_counts, unsigned int column_count, const uint32_t *subsets, const uint32_t *subset_offsets, unsigned int subset_count, const int8_t *groups, uint8_t correct_guess, uint32_t *ranks, unsigned int thread_count);
+void dpa_class_projection(const double *class_sums, unsigned int column_count, const double *weights, unsigned int guess_count, const double *column_norm, double *max_abs, uint32_t *argmax, unsigned int thread_count);
+void dpa_class_combine(const double *class_sums, unsigned int column_count, const double *weights, unsigned int guess_count, double *combined, unsigned int thread_count);
+void dpa_add_sums(double *target, const double *source, size_t count);
+/***************  AUTO GENERATED SECTION ENDS   ***************/
+
+#endif
@@ -0,0 +1,540 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "aes128_bitsliced.h"
+#include "dpa_threads.h"
+#include "dpa_key_enum.h"
+
+/* Full keys are enumerated in optimal order (strictly by decreasing sum of
+ * keybyte scores) by a balanced binary tree of merge nodes over the 16
+ * keybytes. Every node lazily produces its candidates in sorted order from
+ * the candidates of its two children: the frontier of the two-dimensional
+ * (left index, right index) grid is kept in a max-heap, and since popping
+ * (i, j) only pushes (i, j + 1) and, for j = 0, also (i + next row, 0), every
+ * grid point is visited exactly once without a visited set.
+ *
+ * Walking the heaps costs about as much as verifying the candidates, so
+ * enumeration is split across threads as well: every thread owns a private
+ * tree whose root only covers every thread_count-th row of the root grid and
+ * verifies the chunks of candidates it produces with the bitsliced AES.
+ * Between rounds, the queued scores of all partitions are merged up to the
+ * highest score a partition could still produce. This keeps the order of
+ * candidates with distinct scores (and thus their rank) exactly that of a
+ * single tree; candidates of equal score are ordered by partition. */
+
+#define CHUNK_KEYS						(64 * AES128_BITSLICED_LANES)
+#define DEFAULT_RANK_BINS				1024
+
+enum enum_result_t {
+	ENUM_OK,
+	ENUM_EXHAUSTED,
+	ENUM_OUT_OF_MEMORY,
+};
+
+struct enum_entry_t {
+	double score;
+	uint32_t left, right;
+};
+
+struct enum_node_t {
+	int keybyte;
+	struct enum_node_t *left, *right;
+	uint32_t first_row, row_stride;
+	struct enum_entry_t *entries;
+	size_t entry_count, entry_capacity;
+	struct enum_entry_t *heap;
+	size_t heap_count, heap_capacity;
+	bool started;
+};
+
+static bool append_entry(struct enum_entry_t **array, size_t *count, size_t *capacity, const struct enum_entry_t *entry) {
+	if (*count == *capacity) {
+		size_t new_capacity = (*capacity) ? (2 * *capacity) : 256;
+		struct enum_entry_t *new_array = realloc(*array, new_capacity * sizeof(struct enum_entry_t));
+		if (!new_array) {
+			return false;
+		}
+		*array = new_array;
+		*capacity = new_capacity;
+	}
+	(*array)[(*count)++] = *entry;
+	return true;
+}
+
+static bool heap_push(struct enum_node_t *node, const struct enum_entry_t *entry) {
+	if (!append_entry(&node->heap, &node->heap_count, &node->heap_capacity, entry)) {
+		return false;
+	}
+	size_t index = node->heap_count - 1;
+	while (index > 0) {
+		size_t parent = (index - 1) / 2;
+		if (node->heap[parent].score >= node->heap[index].score) {
+			break;
+		}
+		struct enum_entry_t tmp = node->heap[parent];
+		node->heap[parent] = node->heap[index];
+		node->heap[index] = tmp;
+		index = parent;
+	}
+	return true;
+}
+
+static struct enum_entry_t heap_pop(struct enum_node_t *node) {
+	struct enum_entry_t top = node->heap[0];
+	node->heap[0] = node->heap[--node->heap_count];
+	size_t index = 0;
+	while (true) {
+		size_t largest = index;
+		size_t left = (2 * index) + 1;
+		size_t right = left + 1;
+		if ((left < node->heap_count) && (node->heap[left].score > node->heap[largest].score)) {
+			largest = left;
+		}
+		if ((right < node->heap_count) && (node->heap[right].score > node->heap[largest].score)) {
+			largest = right;
+		}
+		if (largest == index) {
+			break;
+		}
+		struct enum_entry_t tmp = node->heap[largest];
+		node->heap[largest] = node->heap[index];
+		node->heap[index] = tmp;
+		index = largest;
+	}
+	return top;
+}
+
+static enum enum_result_t node_get(struct enum_node_t *node, size_t index, struct enum_entry_t *entry);
+static void node_free(struct enum_node_t *node);
+
+static bool node_push_pair(struct enum_node_t *node, uint32_t i, uint32_t j) {
+	struct enum_entry_t left, right;
+	enum enum_result_t result = node_get(node->left, i, &left);
+	if (result == ENUM_OK) {
+		result = node_get(node->right, j, &right);
+	}
+	if (result == ENUM_EXHAUSTED) {
+		/* Grid point does not exist, i.e., child is exhausted */
+		return true;
+	} else if (result == ENUM_OUT_OF_MEMORY) {
+		return false;
+	}
+	struct enum_entry_t entry = {
+		.score = left.score + right.score,
+		.left = i,
+		.right = j,
+	};
+	return heap_push(node, &entry);
+}
+
+/* Produces the next best candidate of an inner node */
+static enum enum_result_t node_next(struct enum_node_t *node, struct enum_entry_t *entry) {
+	if (!node->started) {
+		node->started = true;
+		if (!node_push_pair(node, node->first_row, 0)) {
+			return ENUM_OUT_OF_MEMORY;
+		}
+	}
+	if (node->heap_count == 0) {
+		return ENUM_EXHAUSTED;
+	}
+	*entry = heap_pop(node);
+	if (!node_push_pair(node, entry->left, entry->right + 1)) {
+		return ENUM_OUT_OF_MEMORY;
+	}
+	if ((entry->right == 0) && !node_push_pair(node, entry->left + node->row_stride, 0)) {
+		return ENUM_OUT_OF_MEMORY;
+	}
+	return ENUM_OK;
+}
+
+/* Returns the index-th best candidate of a node, producing (and caching)
+ * candidates as needed */
+static enum enum_result_t node_get(struct enum_node_t *node, size_t index, struct enum_entry_t *entry) {
+	while (node->entry_count <= index) {
+		if (node->keybyte >= 0) {
+			return ENUM_EXHAUSTED;
+		}
+		struct enum_entry_t next;
+		const enum enum_result_t result = node_next(node, &next);
+		if (result != ENUM_OK) {
+			return result;
+		}
+		if (!append_entry(&node->entries, &node->entry_count, &node->entry_capacity, &next)) {
+			return ENUM_OUT_OF_MEMORY;
+		}
+	}
+	*entry = node->entries[index];
+	return ENUM_OK;
+}
+
+static void node_key(struct enum_node_t *node, const struct enum_entry_t *entry, uint8_t key[static 16]) {
+	if (node->keybyte >= 0) {
+		key[node->keybyte] = entry->left;
+	} else {
+		struct enum_entry_t child;
+		node_get(node->left, entry->left, &child);
+		node_key(node->left, &child, key);
+		node_get(node->right, entry->right, &child);
+		node_key(node->right, &child, key);
+	}
+}
+
+static int compare_entries_descending(const void *va, const void *vb) {
+	const struct enum_entry_t *a = (const struct enum_entry_t*)va;
+	const struct enum_entry_t *b = (const struct enum_entry_t*)vb;
+	return (a->score < b->score) ? 1 : (a->score > b->score) ? -1 : 0;
+}
+
+static struct enum_node_t *node_build(const double *scores, int first_keybyte, int last_keybyte) {
+	struct enum_node_t *node = calloc(1, sizeof(struct enum_node_t));
+	if (!node) {
+		return NULL;
+	}
+	if (first_keybyte == last_keybyte) {
+		node->keybyte = first_keybyte;
+		node->entries = malloc(256 * sizeof(struct enum_entry_t));
+		if (!node->entries) {
+			free(node);
+			return NULL;
+		}
+		for (unsigned int value = 0; value < 256; value++) {
+			node->entries[value] = (struct enum_entry_t) {
+				.score = scores[(256 * first_keybyte) + value],
+				.left = value,
+			};
+		}
+		qsort(node->entries, 256, sizeof(struct enum_entry_t), compare_entries_descending);
+		node->entry_count = 256;
+		node->entry_capacity = 256;
+	} else {
+		const int mid = (first_keybyte + last_keybyte) / 2;
+		node->keybyte = -1;
+		node->row_stride = 1;
+		node->left = node_build(scores, first_keybyte, mid);
+		node->right = node_build(scores, mid + 1, last_keybyte);
+		if (!node->left || !node->right) {
+			node_free(node);
+			return NULL;
+		}
+	}
+	return node;
+}
+
+static void node_free(struct enum_node_t *node) {
+	if (node) {
+		node_free(node->left);
+		node_free(node->right);
+		free(node->entries);
+		free(node->heap);
+		free(node);
+	}
+}
+
+struct enum_partition_t {
+	struct enum_node_t *root;
+	uint8_t (*keys)[16];
+	double *queue;
+	unsigned int queue_length;
+	uint64_t consumed;
+	bool exhausted;
+	bool out_of_memory;
+	int64_t found_position;
+	uint8_t found_key[16];
+};
+
+struct enum_ctx_t {
+	struct enum_partition_t *partitions;
+	const uint8_t *plaintext;
+	const uint8_t *ciphertext;
+	bool found;
+};
+
+/* Tops up the queue of one partition by a chunk of candidates and verifies
+ * them. Positions are counted within the partition's stream of candidates. */
+static void enumerate_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	struct enum_ctx_t *ctx = (struct enum_ctx_t*)vctx;
+	struct enum_partition_t *partition = &ctx->partitions[thread_index];
+	if (partition->exhausted || partition->out_of_memory || (partition->queue_length >= 2 * CHUNK_KEYS)) {
+		return;
+	}
+
+	unsigned int key_count = 0;
+	while (key_count < CHUNK_KEYS) {
+		struct enum_entry_t entry;
+		const enum enum_result_t result = node_next(partition->root, &entry);
+		if (result == ENUM_OUT_OF_MEMORY) {
+			partition->out_of_memory = true;
+			return;
+		} else if (result == ENUM_EXHAUSTED) {
+			partition->exhausted = true;
+			break;
+		}
+		node_key(partition->root, &entry, partition->keys[key_count]);
+		partition->queue[partition->queue_length + key_count] = entry.score;
+		key_count++;
+	}
+
+	if (!ctx->found && (partition->found_position < 0)) {
+		for (unsigned int offset = 0; offset < key_count; offset += AES128_BITSLICED_LANES) {
+			const unsigned int count = ((key_count - offset) < AES128_BITSLICED_LANES) ? (key_count - offset) : AES128_BITSLICED_LANES;
+			const uint64_t match = aes128_bitsliced_match(partition->keys + offset, count, ctx->plaintext, ctx->ciphertext);
+			if (match) {
+				const unsigned int index = offset + __builtin_ctzll(match);
+				partition->found_position = partition->consumed + partition->queue_length + index;
+				memcpy(partition->found_key, partition->keys[index], 16);
+				break;
+			}
+		}
+	}
+	partition->queue_length += key_count;
+}
+
+static unsigned int count_above(const double *queue, unsigned int length, double score) {
+	unsigned int count = 0;
+	while ((count < length) && (queue[count] > score)) {
+		count++;
+	}
+	return count;
+}
+
+static unsigned int count_equal(const double *queue, unsigned int start, unsigned int length, double score) {
+	unsigned int count = 0;
+	while ((start + count < length) && (queue[start + count] == score)) {
+		count++;
+	}
+	return count;
+}
+
+/* Enumerates up to max_candidates full keys in the order of decreasing score
+ * sum (scores being [16][256]) and verifies each against one known
+ * plaintext/ciphertext pair. Returns DPA_KEY_FOUND and the key together with
+ * its 1-based rank if found, DPA_KEY_NOT_FOUND if none of the candidates
+ * matched and DPA_KEY_ENUM_OUT_OF_MEMORY if the enumeration could not be
+ * completed. */
+enum dpa_key_enum_result_t dpa_key_enumerate(const double *scores, const uint8_t plaintext[static 16], const uint8_t ciphertext[static 16], uint64_t max_candidates, unsigned int thread_count, uint8_t key[static 16], uint64_t *rank) {
+	if (thread_count < 1) {
+		thread_count = 1;
+	} else if (thread_count > DPA_MAX_THREADS) {
+		thread_count = DPA_MAX_THREADS;
+	}
+
+	enum dpa_key_enum_result_t result = DPA_KEY_ENUM_OUT_OF_MEMORY;
+	struct enum_ctx_t ctx = {
+		.partitions = calloc(thread_count, sizeof(struct enum_partition_t)),
+		.plaintext = plaintext,
+		.ciphertext = ciphertext,
+	};
+	unsigned int *take = calloc(thread_count, sizeof(unsigned int));
+	if (!ctx.partitions || !take) {
+		goto out;
+	}
+	for (unsigned int i = 0; i < thread_count; i++) {
+		struct enum_partition_t *partition = &ctx.partitions[i];
+		partition->root = node_build(scores, 0, 15);
+		partition->keys = malloc(CHUNK_KEYS * 16);
+		partition->queue = malloc(3 * CHUNK_KEYS * sizeof(double));
+		partition->found_position = -1;
+		if (!partition->root || !partition->keys || !partition->queue) {
+			goto out;
+		}
+		partition->root->first_row = i;
+		partition->root->row_stride = thread_count;
+	}
+
+	uint64_t consumed = 0;
+	while (true) {
+		dpa_run_threaded(enumerate_thread, &ctx, thread_count);
+		for (unsigned int i = 0; i < thread_count; i++) {
+			if (ctx.partitions[i].out_of_memory) {
+				goto out;
+			}
+			if (ctx.partitions[i].found_position >= 0) {
+				ctx.found = true;
+			}
+		}
+
+		/* Every candidate scoring higher than the last queued candidate of
+		 * all partitions that can still produce more has been produced.
+		 * Candidates of exactly that score can only be taken up to the first
+		 * such partition, since they are ordered by partition. */
+		double threshold = -INFINITY;
+		for (unsigned int i = 0; i < thread_count; i++) {
+			const struct enum_partition_t *partition = &ctx.partitions[i];
+			if (!partition->exhausted && (partition->queue[partition->queue_length - 1] > threshold)) {
+				threshold = partition->queue[partition->queue_length - 1];
+			}
+		}
+		uint64_t taken = 0;
+		for (unsigned int i = 0; i < thread_count; i++) {
+			take[i] = count_above(ctx.partitions[i].queue, ctx.partitions[i].queue_length, threshold);
+		}
+		for (unsigned int i = 0; i < thread_count; i++) {
+			const struct enum_partition_t *partition = &ctx.partitions[i];
+			take[i] += count_equal(partition->queue, take[i], partition->queue_length, threshold);
+			if (!partition->exhausted && (partition->queue[partition->queue_length - 1] == threshold)) {
+				break;
+			}
+		}
+		for (unsigned int i = 0; i < thread_count; i++) {
+			taken += take[i];
+		}
+
+		for (unsigned int f = 0; f < thread_count; f++) {
+			const struct enum_partition_t *found = &ctx.partitions[f];
+			if ((found->found_position < 0) || ((uint64_t)found->found_position >= found->consumed + take[f])) {
+				continue;
+			}
+			const unsigned int index = found->found_position - found->consumed;
+			const double score = found->queue[index];
+			uint64_t found_rank = consumed + index + 1;
+			for (unsigned int i = 0; i < thread_count; i++) {
+				if (i != f) {
+					const unsigned int above = count_above(ctx.partitions[i].queue, take[i], score);
+					found_rank += above;
+					if (i < f) {
+						found_rank += count_equal(ctx.partitions[i].queue, above, take[i], score);
+					}
+				}
+			}
+			if (found_rank <= max_candidates) {
+				memcpy(key, found->found_key, 16);
+				*rank = found_rank;
+				result = DPA_KEY_FOUND;
+			} else {
+				result = DPA_KEY_NOT_FOUND;
+			}
+			goto out;
+		}
+
+		consumed += taken;
+		if ((consumed >= max_candidates) || (taken == 0)) {
+			/* Nothing left to take means all partitions are exhausted */
+			result = DPA_KEY_NOT_FOUND;
+			goto out;
+		}
+		for (unsigned int i = 0; i < thread_count; i++) {
+			struct enum_partition_t *partition = &ctx.partitions[i];
+			memmove(partition->queue, partition->queue + take[i], (partition->queue_length - take[i]) * sizeof(double));
+			partition->queue_length -= take[i];
+			partition->consumed += take[i];
+		}
+	}
+
+out:
+	if (ctx.partitions) {
+		for (unsigned int i = 0; i < thread_count; i++) {
+			node_free(ctx.partitions[i].root);
+			free(ctx.partitions[i].keys);
+			free(ctx.partitions[i].queue);
+		}
+	}
+	free(ctx.partitions);
+	free(take);
+	return result;
+}
+
+/* Histogram based rank estimation: every keybyte's scores are binned with a
+ * common bin width, the 16 histograms are convolved into the distribution of
+ * full key scores and the keys in bins above the bin of the given key are
+ * counted. Since every keybyte contributes a quantization error of less than
+ * one bin, the true rank is bracketed by shifting the threshold by 16 bins. */
+void dpa_key_rank_estimate(const double *scores, const uint8_t key[static 16], unsigned int bin_count, double *rank_lower, double *rank_estimate, double *rank_upper) {
+	if (bin_count < 2) {
+		bin_count = DEFAULT_RANK_BINS;
+	}
+
+	double min_score = scores[0], max_score = scores[0];
+	for (unsigned int i = 0; i < 16 * 256; i++) {
+		if (scores[i] < min_score) {
+			min_score = scores[i];
+		}
+		if (scores[i] > max_score) {
+			max_score = scores[i];
+		}
+	}
+	const double bin_width = (max_score > min_score) ? ((max_score - min_score) / (bin_count - 1)) : 1;
+
+	const unsigned int total_bins = (16 * (bin_count - 1)) + 1;
+	double *distribution = calloc(total_bins, sizeof(double));
+	double *next_distribution = calloc(total_bins, sizeof(double));
+	double *histogram = calloc(bin_count, sizeof(double));
+	if (!distribution || !next_distribution || !histogram) {
+		*rank_lower = *rank_estimate = *rank_upper = NAN;
+		free(distribution);
+		free(next_distribution);
+		free(histogram);
+		return;
+	}
+
+	distribution[0] = 1;
+	unsigned int distribution_length = 1;
+	unsigned int key_bin = 0;
+	for (unsigned int i = 0; i < 16; i++) {
+		memset(histogram, 0, bin_count * sizeof(double));
+		for (unsigned int value = 0; value < 256; value++) {
+			histogram[(unsigned int)floor((scores[(256 * i) + value] - min_score) / bin_width)]++;
+		}
+		key_bin += (unsigned int)floor((scores[(256 * i) + key[i]] - min_score) / bin_width);
+
+		memset(next_distribution, 0, total_bins * sizeof(double));
+		for (unsigned int a = 0; a < distribution_length; a++) {
+			if (distribution[a] == 0) {
+				continue;
+			}
+			for (unsigned int b = 0; b < bin_count; b++) {
+				next_distribution[a + b] += distribution[a] * histogram[b];
+			}
+		}
+		distribution_length += bin_count - 1;
+
+		double *tmp = distribution;
+		distribution = next_distribution;
+		next_distribution = tmp;
+	}
+
+	double above = 0, above_lower = 0, above_upper = 0;
+	for (unsigned int bin = 0; bin < distribution_length; bin++) {
+		if (bin > key_bin) {
+			above += distribution[bin];
+		}
+		if (bin >= key_bin + 16) {
+			above_lower += distribution[bin];
+		}
+		if (bin + 16 > key_bin) {
+			above_upper += distribution[bin];
+		}
+	}
+	*rank_lower = above_lower + 1;
+	*rank_estimate = above + ((distribution[key_bin] + 1) / 2);
+	*rank_upper = above_upper;
+
+	free(distribution);
+	free(next_distribution);
+	free(histogram);
+}
@@ -0,0 +1,41 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#ifndef __DPA_KEY_ENUM_H__
+#define __DPA_KEY_ENUM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum dpa_key_enum_result_t {
+	DPA_KEY_NOT_FOUND = 0,
+	DPA_KEY_FOUND = 1,
+	DPA_KEY_ENUM_OUT_OF_MEMORY = 2,
+};
+
+/*************** AUTO GENERATED SECTION FOLLOWS ***************/
+enum dpa_key_enum_result_t dpa_key_enumerate(const double *scores, const uint8_t plaintext[static 16], const uint8_t ciphertext[static 16], uint64_t max_candidates, unsigned int thread_count, uint8_t key[static 16], uint64_t *rank);
+void dpa_key_rank_estimate(const double *scores, const uint8_t key[static 16], unsigned int bin_count, double *rank_lower, double *rank_estimate, double *rank_upper);
+/***************  AUTO GENERATED SECTION ENDS   ***************/
+
+#endif
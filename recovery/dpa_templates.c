@@ -0,0 +1,292 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dpa_threads.h"
+#include "dpa_templates.h"
+
+/* Number of traces whose points are transposed into a column-major block
+ * before the scatter matrix is updated, so that the innermost loop runs over
+ * contiguous memory. */
+#define SCATTER_BLOCK			64
+
+/* Copies the given columns (the first column_count columns if columns is
+ * NULL) of every trace into a compact [trace_count][column_count] matrix. */
+void dpa_gather_u8(const uint8_t *samples, size_t sample_stride, unsigned int trace_count, const uint32_t *columns, unsigned int column_count, float *points) {
+	for (unsigned int t = 0; t < trace_count; t++) {
+		const uint8_t *row = samples + ((size_t)t * sample_stride);
+		float *out = points + ((size_t)t * column_count);
+		for (unsigned int k = 0; k < column_count; k++) {
+			out[k] = row[columns ? columns[k] : k];
+		}
+	}
+}
+
+void dpa_gather_f32(const float *samples, size_t sample_stride, unsigned int trace_count, const uint32_t *columns, unsigned int column_count, float *points) {
+	for (unsigned int t = 0; t < trace_count; t++) {
+		const float *row = samples + ((size_t)t * sample_stride);
+		float *out = points + ((size_t)t * column_count);
+		for (unsigned int k = 0; k < column_count; k++) {
+			out[k] = row[columns ? columns[k] : k];
+		}
+	}
+}
+
+struct template_accumulate_ctx_t {
+	const float *points;
+	unsigned int point_count;
+	const uint8_t *classes;
+	unsigned int trace_count;
+	double *thread_class_sums;
+	uint64_t *thread_class_counts;
+	double *thread_scatter;
+};
+
+static void template_accumulate_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	const struct template_accumulate_ctx_t *ctx = (const struct template_accumulate_ctx_t*)vctx;
+	const unsigned int d = ctx->point_count;
+	double *class_sums = ctx->thread_class_sums + ((size_t)thread_index * DPA_TEMPLATE_CLASSES * d);
+	uint64_t *class_counts = ctx->thread_class_counts + ((size_t)thread_index * DPA_TEMPLATE_CLASSES);
+	double *scatter = ctx->thread_scatter + ((size_t)thread_index * d * d);
+	double block[DPA_TEMPLATE_MAX_POINTS][SCATTER_BLOCK];
+
+	const unsigned int t0 = (unsigned int)(((uint64_t)ctx->trace_count * thread_index) / thread_count);
+	const unsigned int t1 = (unsigned int)(((uint64_t)ctx->trace_count * (thread_index + 1)) / thread_count);
+	for (unsigned int tb = t0; tb < t1; tb += SCATTER_BLOCK) {
+		const unsigned int width = (tb + SCATTER_BLOCK < t1) ? SCATTER_BLOCK : (t1 - tb);
+		for (unsigned int t = 0; t < width; t++) {
+			const float *row = ctx->points + ((size_t)(tb + t) * d);
+			double *class_row = class_sums + ((size_t)ctx->classes[tb + t] * d);
+			for (unsigned int a = 0; a < d; a++) {
+				block[a][t] = row[a];
+				class_row[a] += row[a];
+			}
+			class_counts[ctx->classes[tb + t]]++;
+		}
+
+		/* Only the upper triangle is accumulated */
+		for (unsigned int a = 0; a < d; a++) {
+			for (unsigned int b = a; b < d; b++) {
+				double sum = 0;
+				for (unsigned int t = 0; t < width; t++) {
+					sum += block[a][t] * block[b][t];
+				}
+				scatter[(a * d) + b] += sum;
+			}
+		}
+	}
+}
+
+/* Adds profiling traces, given as [trace_count][point_count] matrix of the
+ * points of interest and the class (e.g., the S-box output) of every trace,
+ * to the per-class sums and to the raw scatter matrix sum_t x_t x_t^T. The
+ * pooled covariance follows from these as (scatter - sum_c n_c mu_c mu_c^T) /
+ * (n - classes), so any number of traces can be streamed through in batches
+ * with bounded memory. */
+void dpa_template_accumulate(const float *points, unsigned int point_count, const uint8_t *classes, unsigned int trace_count, double *class_sums, uint64_t *class_counts, double *scatter, unsigned int thread_count) {
+	if (point_count > DPA_TEMPLATE_MAX_POINTS) {
+		return;
+	}
+	if (thread_count < 1) {
+		thread_count = 1;
+	} else if (thread_count > DPA_MAX_THREADS) {
+		thread_count = DPA_MAX_THREADS;
+	}
+	const unsigned int d = point_count;
+	double *thread_class_sums = calloc((size_t)thread_count * DPA_TEMPLATE_CLASSES * d, sizeof(double));
+	uint64_t *thread_class_counts = calloc((size_t)thread_count * DPA_TEMPLATE_CLASSES, sizeof(uint64_t));
+	double *thread_scatter = calloc((size_t)thread_count * d * d, sizeof(double));
+	if (!thread_class_sums || !thread_class_counts || !thread_scatter) {
+		free(thread_class_sums);
+		free(thread_class_counts);
+		free(thread_scatter);
+		return;
+	}
+
+	struct template_accumulate_ctx_t ctx = {
+		.points = points,
+		.point_count = point_count,
+		.classes = classes,
+		.trace_count = trace_count,
+		.thread_class_sums = thread_class_sums,
+		.thread_class_counts = thread_class_counts,
+		.thread_scatter = thread_scatter,
+	};
+	dpa_run_threaded(template_accumulate_thread, &ctx, thread_count);
+
+	for (unsigned int i = 0; i < thread_count; i++) {
+		for (size_t k = 0; k < (size_t)DPA_TEMPLATE_CLASSES * d; k++) {
+			class_sums[k] += thread_class_sums[((size_t)i * DPA_TEMPLATE_CLASSES * d) + k];
+		}
+		for (unsigned int c = 0; c < DPA_TEMPLATE_CLASSES; c++) {
+			class_counts[c] += thread_class_counts[((size_t)i * DPA_TEMPLATE_CLASSES) + c];
+		}
+		for (unsigned int a = 0; a < d; a++) {
+			for (unsigned int b = a; b < d; b++) {
+				const double value = thread_scatter[((size_t)i * d * d) + (a * d) + b];
+				scatter[(a * d) + b] += value;
+				if (a != b) {
+					scatter[(b * d) + a] += value;
+				}
+			}
+		}
+	}
+	free(thread_class_sums);
+	free(thread_class_counts);
+	free(thread_scatter);
+}
+
+/* In-place Cholesky decomposition of a symmetric n x n matrix into the lower
+ * triangular L with matrix = L L^T; the upper triangle is zeroed. Returns
+ * false if the matrix is not positive definite. */
+bool dpa_cholesky(double *matrix, unsigned int n) {
+	for (unsigned int j = 0; j < n; j++) {
+		double diagonal = matrix[(j * n) + j];
+		for (unsigned int k = 0; k < j; k++) {
+			diagonal -= matrix[(j * n) + k] * matrix[(j * n) + k];
+		}
+		if (!(diagonal > 0)) {
+			return false;
+		}
+		diagonal = sqrt(diagonal);
+		matrix[(j * n) + j] = diagonal;
+		for (unsigned int i = j + 1; i < n; i++) {
+			double value = matrix[(i * n) + j];
+			for (unsigned int k = 0; k < j; k++) {
+				value -= matrix[(i * n) + k] * matrix[(j * n) + k];
+			}
+			matrix[(i * n) + j] = value / diagonal;
+		}
+		for (unsigned int i = 0; i < j; i++) {
+			matrix[(i * n) + j] = 0;
+		}
+	}
+	return true;
+}
+
+/* Solves L y = x for lower triangular L */
+static void forward_substitute(const double *cholesky, unsigned int n, const double *x, double *y) {
+	for (unsigned int i = 0; i < n; i++) {
+		double value = x[i];
+		for (unsigned int k = 0; k < i; k++) {
+			value -= cholesky[(i * n) + k] * y[k];
+		}
+		y[i] = value / cholesky[(i * n) + i];
+	}
+}
+
+struct template_match_ctx_t {
+	const float *points;
+	unsigned int point_count;
+	const uint8_t *plaintext_bytes;
+	unsigned int trace_count;
+	const double *whitened_means;
+	const double *cholesky;
+	const uint8_t *hypotheses;
+	double *thread_scores;
+};
+
+static void template_match_thread(void *vctx, unsigned int thread_index, unsigned int thread_count) {
+	const struct template_match_ctx_t *ctx = (const struct template_match_ctx_t*)vctx;
+	const unsigned int d = ctx->point_count;
+	double *scores = ctx->thread_scores + ((size_t)thread_index * 256);
+	double x[DPA_TEMPLATE_MAX_POINTS], y[DPA_TEMPLATE_MAX_POINTS];
+	double log_likelihood[DPA_TEMPLATE_CLASSES];
+
+	for (unsigned int t = thread_index; t < ctx->trace_count; t += thread_count) {
+		const float *row = ctx->points + ((size_t)t * d);
+		for (unsigned int k = 0; k < d; k++) {
+			x[k] = row[k];
+		}
+		forward_substitute(ctx->cholesky, d, x, y);
+
+		/* With whitened points and means, the log-likelihood of a class is
+		 * half the negative squared distance (up to a common constant) */
+		for (unsigned int c = 0; c < DPA_TEMPLATE_CLASSES; c++) {
+			const double *mean = ctx->whitened_means + ((size_t)c * d);
+			double distance = 0;
+			for (unsigned int k = 0; k < d; k++) {
+				const double diff = y[k] - mean[k];
+				distance += diff * diff;
+			}
+			log_likelihood[c] = -0.5 * distance;
+		}
+
+		const uint8_t *hypotheses = ctx->hypotheses + ((size_t)ctx->plaintext_bytes[t] * 256);
+		for (unsigned int guess = 0; guess < 256; guess++) {
+			scores[guess] += log_likelihood[hypotheses[guess]];
+		}
+	}
+}
+
+/* Adds the log-likelihood of every key guess over all given traces to scores.
+ * means is [DPA_TEMPLATE_CLASSES][point_count], cholesky the lower triangular
+ * factor of the pooled covariance and hypotheses [256 plaintext byte values][256
+ * guesses] gives the class predicted for a plaintext byte under a guess. */
+void dpa_template_match(const float *points, unsigned int point_count, const uint8_t *plaintext_bytes, unsigned int trace_count, const double *means, const double *cholesky, const uint8_t *hypotheses, double *scores, unsigned int thread_count) {
+	if (point_count > DPA_TEMPLATE_MAX_POINTS) {
+		return;
+	}
+	if (thread_count < 1) {
+		thread_count = 1;
+	} else if (thread_count > DPA_MAX_THREADS) {
+		thread_count = DPA_MAX_THREADS;
+	}
+	if (thread_count > trace_count) {
+		thread_count = trace_count ? trace_count : 1;
+	}
+	const unsigned int d = point_count;
+	double *whitened_means = malloc(sizeof(double) * DPA_TEMPLATE_CLASSES * d);
+	double *thread_scores = calloc((size_t)thread_count * 256, sizeof(double));
+	if (!whitened_means || !thread_scores) {
+		free(whitened_means);
+		free(thread_scores);
+		return;
+	}
+	for (unsigned int c = 0; c < DPA_TEMPLATE_CLASSES; c++) {
+		forward_substitute(cholesky, d, means + ((size_t)c * d), whitened_means + ((size_t)c * d));
+	}
+
+	struct template_match_ctx_t ctx = {
+		.points = points,
+		.point_count = point_count,
+		.plaintext_bytes = plaintext_bytes,
+		.trace_count = trace_count,
+		.whitened_means = whitened_means,
+		.cholesky = cholesky,
+		.hypotheses = hypotheses,
+		.thread_scores = thread_scores,
+	};
+	dpa_run_threaded(template_match_thread, &ctx, thread_count);
+
+	for (unsigned int i = 0; i < thread_count; i++) {
+		for (unsigned int guess = 0; guess < 256; guess++) {
+			scores[guess] += thread_scores[((size_t)i * 256) + guess];
+		}
+	}
+	free(whitened_means);
+	free(thread_scores);
+}
@@ -0,0 +1,42 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#ifndef __DPA_TEMPLATES_H__
+#define __DPA_TEMPLATES_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DPA_TEMPLATE_CLASSES		256
+#define DPA_TEMPLATE_MAX_POINTS		256
+
+/*************** AUTO GENERATED SECTION FOLLOWS ***************/
+void dpa_gather_u8(const uint8_t *samples, size_t sample_stride, unsigned int trace_count, const uint32_t *columns, unsigned int column_count, float *points);
+void dpa_gather_f32(const float *samples, size_t sample_stride, unsigned int trace_count, const uint32_t *columns, unsigned int column_count, float *points);
+void dpa_template_accumulate(const float *points, unsigned int point_count, const uint8_t *classes, unsigned int trace_count, double *class_sums, uint64_t *class_counts, double *scatter, unsigned int thread_count);
+bool dpa_cholesky(double *matrix, unsigned int n);
+void dpa_template_match(const float *points, unsigned int point_count, const uint8_t *plaintext_bytes, unsigned int trace_count, const double *means, const double *cholesky, const uint8_t *hypotheses, double *scores, unsigned int thread_count);
+/***************  AUTO GENERATED SECTION ENDS   ***************/
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#include <pthread.h>
+#include "dpa_threads.h"
+
+struct thread_arg_t {
+	dpa_thread_fnc_t fnc;
+	void *ctx;
+	unsigned int thread_index;
+	unsigned int thread_count;
+};
+
+static void *thread_trampoline(void *varg) {
+	struct thread_arg_t *arg = (struct thread_arg_t*)varg;
+	arg->fnc(arg->ctx, arg->thread_index, arg->thread_count);
+	return NULL;
+}
+
+/* Runs fnc on thread_count threads (the calling thread being one of them)
+ * and waits for all of them to finish. */
+void dpa_run_threaded(dpa_thread_fnc_t fnc, void *ctx, unsigned int thread_count) {
+	if (thread_count < 1) {
+		thread_count = 1;
+	} else if (thread_count > DPA_MAX_THREADS) {
+		thread_count = DPA_MAX_THREADS;
+	}
+
+	pthread_t threads[DPA_MAX_THREADS];
+	struct thread_arg_t args[DPA_MAX_THREADS];
+	unsigned int started = 1;
+	for (unsigned int i = 0; i < thread_count; i++) {
+		args[i] = (struct thread_arg_t) {
+			.fnc = fnc,
+			.ctx = ctx,
+			.thread_index = i,
+			.thread_count = thread_count,
+		};
+	}
+	for (unsigned int i = 1; i < thread_count; i++) {
+		if (pthread_create(&threads[i], NULL, thread_trampoline, &args[i]) != 0) {
+			break;
+		}
+		started++;
+	}
+	if (started != thread_count) {
+		/* Could not spawn all threads, the remaining work is done inline */
+		for (unsigned int i = started; i < thread_count; i++) {
+			thread_trampoline(&args[i]);
+		}
+	}
+	thread_trampoline(&args[0]);
+	for (unsigned int i = 1; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
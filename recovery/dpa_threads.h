@@ -0,0 +1,35 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#ifndef __DPA_THREADS_H__
+#define __DPA_THREADS_H__
+
+#define DPA_MAX_THREADS			256
+
+typedef void (*dpa_thread_fnc_t)(void *ctx, unsigned int thread_index, unsigned int thread_count);
+
+/*************** AUTO GENERATED SECTION FOLLOWS ***************/
+void dpa_run_threaded(dpa_thread_fnc_t fnc, void *ctx, unsigned int thread_count);
+/***************  AUTO GENERATED SECTION ENDS   ***************/
+
+#endif
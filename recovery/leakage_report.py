@@ -0,0 +1,281 @@
+#!/usr/bin/python3
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import os
+import sys
+import json
+import bisect
+import subprocess
+from FriendlyArgumentParser import FriendlyArgumentParser, baseint
+from Tracefile import Tracefile
+from AttackState import AttackState
+from DPAKernels import DPAKernels
+from dpa_attack import DPAAttack
+
+class SampleMap():
+	def __init__(self, entries):
+		self._entries = sorted(tuple(entry) for entry in entries)
+		self._starts = [ entry[0] for entry in self._entries ]
+
+	def pc(self, sample):
+		index = bisect.bisect_right(self._starts, sample) - 1
+		if index < 0:
+			return None
+		(sample_start, count, pc_start, pc_stride) = self._entries[index]
+		if sample >= sample_start + count:
+			return None
+		return pc_start + ((sample - sample_start) * pc_stride)
+
+class Symbolizer():
+	def __init__(self, elf_filename, toolchain_prefix):
+		self._elf_filename = elf_filename
+		self._toolchain_prefix = toolchain_prefix
+		self._functions = self._read_functions()
+		self._function_starts = [ start for (start, size, name) in self._functions ]
+		self._lines = { }
+
+	def _read_functions(self):
+		output = subprocess.check_output([ self._toolchain_prefix + "nm", "-n", "-S", "--defined-only", self._elf_filename ]).decode()
+		functions = [ ]
+		for line in output.split("\n"):
+			fields = line.split()
+			if len(fields) == 4:
+				(value, size, symtype, name) = fields
+				size = int(size, 16)
+			elif len(fields) == 3:
+				(value, symtype, name) = fields
+				size = None
+			else:
+				continue
+			if symtype in "tTwW":
+				# Thumb function symbols have the LSB set
+				functions.append((int(value, 16) & ~1, size, name))
+		functions.sort()
+		return functions
+
+	def function(self, pc):
+		index = bisect.bisect_right(self._function_starts, pc) - 1
+		if index < 0:
+			return None
+		(start, size, name) = self._functions[index]
+		if (size is not None) and (pc >= start + size):
+			return None
+		return (name, pc - start)
+
+	def resolve_lines(self, pcs):
+		pcs = sorted(set(pc for pc in pcs if pc not in self._lines))
+		if len(pcs) == 0:
+			return
+		output = subprocess.check_output([ self._toolchain_prefix + "addr2line", "-e", self._elf_filename ] + [ "0x%x" % (pc) for pc in pcs ]).decode()
+		for (pc, line) in zip(pcs, output.split("\n")):
+			self._lines[pc] = os.path.basename(line.split(" ")[0]) if not line.startswith("??") else None
+
+	def line(self, pc):
+		return self._lines.get(pc)
+
+# Folds leakage peaks of the accumulated attack state onto the instructions,
+# functions and source lines of the firmware that produced them.
+class LeakageReport():
+	def __init__(self, args):
+		self._args = args
+		self._state = self._load_state()
+		self._correct_key = self._args.correct_key or self._state.key
+		entries = self._load_sample_map()
+		self._sample_map = SampleMap(entries)
+		self._symbolizer = Symbolizer(self._args.elf, self._args.toolchain_prefix)
+		self._metric = self._args.metric or ("dom" if (self._correct_key is not None) else "variance")
+		if (self._metric == "dom") and (self._correct_key is None):
+			raise Exception("The difference of means metric requires the correct key; specify it with --correct-key or use the variance metric.")
+
+	def _load_state(self):
+		if self._args.checkpoint is not None:
+			state = AttackState.read(self._args.checkpoint)
+		else:
+			state = AttackState()
+		if self._args.tracefile is not None:
+			state.update(Tracefile(self._args.tracefile), thread_count = self._args.threads)
+		if state.trace_count == 0:
+			raise Exception("Neither a tracefile nor a checkpoint with traces was given.")
+		return state
+
+	def _load_sample_map(self):
+		if self._args.sample_map is not None:
+			with open(self._args.sample_map) as f:
+				return json.load(f)["entries"]
+		elif self._state.sample_map is not None:
+			return self._state.sample_map
+		else:
+			raise Exception("The traces do not contain a sample map; give the sample_map.json that the simulator wrote with --sample-map.")
+
+	def _dom_trace(self, i):
+		# Difference of means for the correct guess, grouped like dpa_attack
+		class_counts = self._state.class_counts(i)
+		K = self._correct_key[i]
+		groups = { }
+		for P in range(DPAKernels.CLASS_COUNT):
+			Q = P ^ K
+			estimate = DPAAttack._hweight((Q ^ DPAAttack._AES_SBOX[Q]) & 0xff)
+			if estimate <= self._args.grouping_threshold[0]:
+				groups[P] = -1
+			elif estimate >= self._args.grouping_threshold[1]:
+				groups[P] = 1
+		low_count = sum(class_counts[P] for (P, group) in groups.items() if group == -1)
+		high_count = sum(class_counts[P] for (P, group) in groups.items() if group == 1)
+		if (low_count == 0) or (high_count == 0):
+			return [ 0 ] * self._state.sample_count
+		weights = DPAKernels.zeros("d", DPAKernels.CLASS_COUNT)
+		for (P, group) in groups.items():
+			weights[P] = (1 / high_count) if (group == 1) else (-1 / low_count)
+		diff = DPAKernels.class_combine(self._state.class_sums(i), self._state.sample_count, weights, 1, thread_count = self._args.threads)
+		return [ abs(value) for value in diff ]
+
+	def _variance_trace(self, i):
+		# Variance of the per-class means, i.e., the signal part of the SNR
+		# when classifying by the plaintext byte; does not need the key
+		class_counts = self._state.class_counts(i)
+		class_sums = self._state.class_sums(i)
+		sample_count = self._state.sample_count
+		total_count = sum(class_counts)
+		mean = [ 0 ] * sample_count
+		sqmean = [ 0 ] * sample_count
+		for (P, count) in enumerate(class_counts):
+			if count == 0:
+				continue
+			row = class_sums[P * sample_count : (P + 1) * sample_count]
+			mean = [ m + (value / total_count) for (m, value) in zip(mean, row) ]
+			sqmean = [ m + (value * value / count / total_count) for (m, value) in zip(sqmean, row) ]
+		return [ sq - (m * m) for (sq, m) in zip(sqmean, mean) ]
+
+	def _metric_traces(self):
+		keybytes = range(16) if (len(self._args.keybyte) == 0) else self._args.keybyte
+		if self._metric == "dom":
+			return { i: self._dom_trace(i) for i in keybytes }
+		else:
+			return { i: self._variance_trace(i) for i in keybytes }
+
+	def _location(self, pc):
+		if pc is None:
+			return { "pc": None, "function": None, "offset": None, "line": None }
+		function = self._symbolizer.function(pc)
+		return {
+			"pc":			pc,
+			"function":		None if (function is None) else function[0],
+			"offset":		None if (function is None) else function[1],
+			"line":			self._symbolizer.line(pc),
+		}
+
+	def _windows(self, combined):
+		# Contiguous sample ranges in which the metric exceeds the given
+		# fraction of its maximum, widened by the margin and merged
+		threshold = self._args.window_threshold * max(value for (value, i) in combined)
+		windows = [ ]
+		for (sample, (value, i)) in enumerate(combined):
+			if value < threshold:
+				continue
+			(start, end) = (max(0, sample - self._args.window_margin), min(len(combined), sample + self._args.window_margin + 1))
+			if (len(windows) > 0) and (start <= windows[-1][1]):
+				windows[-1] = (windows[-1][0], max(windows[-1][1], end))
+			else:
+				windows.append((start, end))
+		return windows
+
+	def report(self):
+		traces = self._metric_traces()
+
+		# For every sample, the keybyte that leaks the most
+		combined = [ max((trace[sample], i) for (i, trace) in traces.items()) for sample in range(self._state.sample_count) ]
+		pcs = [ self._sample_map.pc(sample) for sample in range(self._state.sample_count) ]
+		self._symbolizer.resolve_lines(pc for pc in pcs if pc is not None)
+
+		peaks = sorted(range(len(combined)), key = lambda sample: combined[sample][0], reverse = True)[:self._args.top]
+		peaks = [ dict(sample = sample, keybyte = combined[sample][1], value = combined[sample][0], **self._location(pcs[sample])) for sample in peaks ]
+
+		functions = { }
+		lines = { }
+		for (sample, (value, i)) in enumerate(combined):
+			location = self._location(pcs[sample])
+			for (key, folded) in [ (location["function"], functions), (location["line"], lines) ]:
+				entry = folded.setdefault(key or "??", { "samples": 0, "sum": 0, "peak": 0, "first_sample": sample, "last_sample": sample })
+				entry["samples"] += 1
+				entry["sum"] += value
+				entry["peak"] = max(entry["peak"], value)
+				entry["last_sample"] = sample
+
+		return {
+			"metric":		self._metric,
+			"trace_count":	self._state.trace_count,
+			"peaks":		peaks,
+			"functions":	functions,
+			"lines":		lines,
+			"windows":		self._windows(combined),
+		}
+
+	def print_report(self, report):
+		print("Leakage metric %s over %d traces" % (report["metric"], report["trace_count"]))
+		print()
+		print("Top %d peaks:" % (len(report["peaks"])))
+		print("  Sample  Byte       Value  PC          Location")
+		for peak in report["peaks"]:
+			pc = "-" if (peak["pc"] is None) else "0x%08x" % (peak["pc"])
+			function = "??" if (peak["function"] is None) else "%s+0x%x" % (peak["function"], peak["offset"])
+			print("  %6d  %4d  %10.4f  %-10s  %s (%s)" % (peak["sample"], peak["keybyte"], peak["value"], pc, function, peak["line"] or "??"))
+
+		for (title, folded) in [ ("function", report["functions"]), ("source line", report["lines"]) ]:
+			print()
+			print("Leakage by %s:" % (title))
+			print("  %-32s  %7s  %10s  %10s  %s" % (title.capitalize(), "Samples", "Peak", "Sum", "Samples from-to"))
+			for (name, entry) in sorted(folded.items(), key = lambda item: item[1]["peak"], reverse = True)[:self._args.top]:
+				print("  %-32s  %7d  %10.4f  %10.4f  %d-%d" % (name, entry["samples"], entry["peak"], entry["sum"], entry["first_sample"], entry["last_sample"]))
+
+		print()
+		print("Sample windows above %.0f%% of the maximum: %s" % (self._args.window_threshold * 100, " ".join("%d:%d" % (start, end) for (start, end) in report["windows"])))
+
+def _threshold(text):
+	text = text.split(":")
+	return (int(text[0]), int(text[1]))
+
+parser = FriendlyArgumentParser(description = "Attribute leakage peaks to the firmware's functions and source lines using the simulator's sample map.")
+parser.add_argument("-e", "--elf", metavar = "filename", required = True, help = "ELF image of the emulated firmware, e.g., aes128/cortexm/aes128_rom. Mandatory.")
+parser.add_argument("-c", "--checkpoint", metavar = "filename", help = "Attack state checkpoint written by dpa_attack.py to take the accumulated statistics from.")
+parser.add_argument("-s", "--sample-map", metavar = "filename", help = "sample_map.json written by the simulator. By default, the map embedded in the tracefile or checkpoint is used.")
+parser.add_argument("-m", "--metric", choices = [ "dom", "variance" ], help = "Leakage metric. dom is the absolute difference of means of the correct key guess and needs the key, variance is the variance of the per-plaintext-byte class means. Defaults to dom if the key is known.")
+parser.add_argument("-k", "--correct-key", metavar = "hex", type = bytes.fromhex, help = "Use this is the known correct key. Must be given in hex notation.")
+parser.add_argument("-t", "--grouping-threshold", metavar = "low:high", type = _threshold, default = [ 1, 7 ], help = "Gives a lower and upper threshold for grouping with the dom metric. Defaults to %(default)s.")
+parser.add_argument("-i", "--keybyte", metavar = "index", type = int, action = "append", default = [ ], help = "Only consider keybyte at index i. Can be specified multiple times. By default, all keybytes are considered.")
+parser.add_argument("-n", "--top", metavar = "count", type = int, default = 20, help = "Number of peaks, functions and lines to show. Defaults to %(default)d.")
+parser.add_argument("-f", "--window-threshold", metavar = "fraction", type = float, default = 0.5, help = "Suggest sample windows in which the metric exceeds this fraction of its maximum. Defaults to %(default).1f.")
+parser.add_argument("-g", "--window-margin", metavar = "samples", type = int, default = 8, help = "Widen the suggested sample windows by this many samples on each side. Defaults to %(default)d.")
+parser.add_argument("-p", "--toolchain-prefix", metavar = "prefix", default = "arm-none-eabi-", help = "Prefix of the nm and addr2line binaries to use. Defaults to %(default)s.")
+parser.add_argument("-o", "--output", metavar = "filename", help = "Also write the report as JSON to this file.")
+parser.add_argument("-T", "--threads", metavar = "count", type = int, help = "Number of threads to use. Defaults to the number of available CPUs.")
+parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
+parser.add_argument("tracefile", metavar = "tracefile_json", nargs = "?", help = "The JSON source file which contains all collected/simulated traces. May be omitted when a checkpoint is given.")
+
+if __name__ == "__main__":
+	args = parser.parse_args(sys.argv[1:])
+	report = LeakageReport(args)
+	result = report.report()
+	report.print_report(result)
+	if args.output is not None:
+		with open(args.output, "w") as f:
+			json.dump(result, f, indent = 4)
+			f.write("\n")
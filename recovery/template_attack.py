@@ -0,0 +1,143 @@
+#!/usr/bin/python3
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import sys
+import math
+import array
+import collections
+from FriendlyArgumentParser import FriendlyArgumentParser, baseint_unit
+from Tracefile import Tracefile
+from Templates import Templates
+from KeyEnumeration import KeyEnumeration
+from DPAKernels import DPAKernels
+from dpa_attack import DPAAttack
+
+class TemplateAttack():
+	def __init__(self, args):
+		self._args = args
+		self._templates = Templates.read(self._args.templates)
+		self._tracefile = Tracefile(self._args.tracefile)
+		if self._args.randomize:
+			self._tracefile.randomize()
+		self._correct_key = self._args.correct_key or self._tracefile.correct_key
+		self._key = bytearray(16)
+		self._keyguess_metrics = collections.defaultdict(dict)
+
+		# Hypothetical class of every plaintext byte and keybyte guess
+		self._hypotheses = array.array("B", (DPAAttack._AES_SBOX[P ^ K] for P in range(256) for K in range(256)))
+
+	@property
+	def key(self):
+		return self._key
+
+	def _keybytes(self):
+		return range(16) if (len(self._args.keybyte) == 0) else self._args.keybyte
+
+	def attack(self):
+		(samples, trace_count, sample_count) = self._tracefile.sample_matrix(max_traces = self._args.max_traces)
+		if sample_count < self._templates.sample_count:
+			raise Exception("Traces of %d samples do not cover all points of interest of the templates (%d samples)." % (sample_count, self._templates.sample_count))
+		traces = list(self._tracefile)[:trace_count]
+
+		# Matching is done per trace when progress is reported and for all
+		# traces at once otherwise; log-likelihoods just add up
+		steps = range(1, trace_count + 1) if self._args.progress else [ trace_count ]
+		scores = { i: DPAKernels.zeros("d", 256) for i in self._keybytes() }
+		self._progress = collections.defaultdict(dict)
+		for i in self._keybytes():
+			(means, cholesky) = self._templates.model(i, ridge = self._args.ridge)
+			d = len(self._templates.pois[i])
+			points = DPAKernels.gather(samples, sample_count, trace_count, columns = self._templates.pois[i])
+			plaintext_bytes = array.array("B", (trace["plaintext"][i] for trace in traces))
+			previous = 0
+			for step in steps:
+				DPAKernels.template_match(points[previous * d : step * d], d, plaintext_bytes[previous : step], step - previous, means, cholesky, self._hypotheses, scores[i], thread_count = self._args.threads)
+				previous = step
+				if self._args.progress:
+					self._progress[step][i] = scores[i].tolist()
+			self._keyguess_metrics[i] = dict(enumerate(scores[i]))
+			self._key[i] = max(range(256), key = lambda K: scores[i][K])
+		if self._args.progress:
+			self._print_progress()
+
+	@staticmethod
+	def _rank(scores, K):
+		return sum(1 for guess in range(256) if scores[guess] > scores[K])
+
+	def _print_progress(self):
+		for (step, byte_scores) in sorted(self._progress.items()):
+			key = [ max(range(256), key = lambda K: scores[K]) for (i, scores) in sorted(byte_scores.items()) ]
+			text = "%5d traces: %s" % (step, " ".join("%02x" % (x) for x in key))
+			if self._correct_key is not None:
+				ranks = [ self._rank(scores, self._correct_key[i]) for (i, scores) in sorted(byte_scores.items()) ]
+				correct_count = sum(1 for rank in ranks if rank == 0)
+				search_space = sum(math.log2(rank + 1) for rank in ranks)
+				text += "  %2d of %d keybytes correct, remaining search space 2^%.1f" % (correct_count, len(ranks), search_space)
+			print(text)
+
+	def print_results(self):
+		print("Recovered key after attack: %s" % (" ".join("%02x" % (x) for x in self._key)))
+		for i in self._keyguess_metrics:
+			scores = self._keyguess_metrics[i]
+			best = sorted(scores.values(), reverse = True)
+			text = "   %2d [%02x] log-likelihood margin %8.1f" % (i, self._key[i], best[0] - best[1])
+			if self._correct_key is not None:
+				rank = self._rank(scores, self._correct_key[i])
+				text += "  actual is [%02x] rank %3d %s" % (self._correct_key[i], rank, [ "FAIL", "" ][rank == 0])
+			print(text)
+
+		if (self._args.enumerate is not None) or ((self._args.estimate_rank) and (self._correct_key is not None)):
+			enumeration = KeyEnumeration(self._keyguess_metrics)
+			if self._args.estimate_rank and (self._correct_key is not None):
+				(lower, estimate, upper) = enumeration.estimate_rank(self._correct_key)
+				print("Estimated rank of correct key: 2^%.1f (between 2^%.1f and 2^%.1f)" % (math.log2(estimate), math.log2(lower), math.log2(max(1, upper))))
+			if self._args.enumerate is not None:
+				trace = next(iter(self._tracefile))
+				try:
+					(key, rank) = enumeration.enumerate(trace["plaintext"], trace["ciphertext"], self._args.enumerate, thread_count = self._args.threads)
+				except MemoryError as e:
+					print("Key enumeration failed: %s" % (e))
+				else:
+					if key is None:
+						print("Key enumeration: key not found among the %d most likely candidates." % (self._args.enumerate))
+					else:
+						print("Key enumeration: found key %s at rank %d (2^%.1f)" % (" ".join("%02x" % (x) for x in key), rank, math.log2(rank)))
+
+parser = FriendlyArgumentParser(description = "Profiled template attack on the first round S-box output using templates built by template_profile.py.")
+parser.add_argument("-k", "--correct-key", metavar = "hex", type = bytes.fromhex, help = "Use this is the known correct key. Must be given in hex notation.")
+parser.add_argument("-n", "--max-traces", metavar = "count", type = int, help = "Use this number of traces at maximum. By default, all traces in the tracefile are used.")
+parser.add_argument("-i", "--keybyte", metavar = "index", type = int, action = "append", default = [ ], help = "Attack keybyte at index i. Can be specified multiple times. By default, all keybytes are tried.")
+parser.add_argument("-r", "--randomize", action = "store_true", help = "Randomly shuffle traces before starting.")
+parser.add_argument("-p", "--progress", action = "store_true", help = "Print the recovered key after every trace, including the number of correct keybytes if the key is known.")
+parser.add_argument("-g", "--ridge", metavar = "value", type = float, default = 1e-3, help = "Regularization added to the diagonal of the pooled covariance, relative to the average variance of the points of interest. Defaults to %(default)g.")
+parser.add_argument("-e", "--enumerate", metavar = "count", type = baseint_unit, help = "After the attack, enumerate up to this many full key candidates in order of their score and verify them against a known plaintext/ciphertext pair. Accepts suffixes like k, M or Gi.")
+parser.add_argument("-R", "--estimate-rank", action = "store_true", help = "After the attack, estimate the rank of the correct key among all full keys. Requires the correct key to be known.")
+parser.add_argument("-T", "--threads", metavar = "count", type = int, help = "Number of threads used for the native kernels and key enumeration. Defaults to the number of available CPUs.")
+parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
+parser.add_argument("templates", metavar = "templates", help = "Templates created by template_profile.py.")
+parser.add_argument("tracefile", metavar = "tracefile_json", help = "The JSON source file which contains the traces of the device under attack.")
+
+if __name__ == "__main__":
+	args = parser.parse_args(sys.argv[1:])
+	attack = TemplateAttack(args)
+	attack.attack()
+	attack.print_results()
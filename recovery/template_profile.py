@@ -0,0 +1,178 @@
+#!/usr/bin/python3
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import os
+import sys
+import array
+import random
+from FriendlyArgumentParser import FriendlyArgumentParser
+from Tracefile import Tracefile
+from Templates import Templates
+from DPAKernels import DPAKernels
+from dpa_attack import DPAAttack
+
+class TemplateProfile():
+	def __init__(self, args):
+		self._args = args
+		self._sample_count = None
+
+	def _simulated_batches(self):
+		# Deterministic for a given seed, so that both profiling passes see
+		# the very same traces without keeping them around
+		sys.path.append(os.path.dirname(os.path.realpath(__file__)) + "/../simulator")
+		from DPASim import DPASim
+		prng = random.Random(self._args.seed)
+		first = 0
+		with DPASim(self._args.firmware, track_ram = self._args.track_ram) as sim:
+			while first < self._args.trace_count:
+				trace_count = min(self._args.trace_count - first, self._args.batch_size)
+				keys = bytes(prng.getrandbits(8) for i in range(16 * trace_count))
+				plaintexts = bytes(prng.getrandbits(8) for i in range(16 * trace_count))
+				randomness = bytes(prng.getrandbits(8) for i in range(16 * trace_count))
+				(samples, trace_lengths, ciphertexts) = sim.generate(keys, plaintexts, randomness, sample_stride = self._args.max_trace_length)
+				source = { "seed": self._args.seed, "first": first, "trace_count": trace_count }
+				yield (samples, self._args.max_trace_length, min(trace_lengths), trace_count, keys, plaintexts, source)
+				first += trace_count
+
+	def _tracefile_batches(self):
+		for filename in self._args.tracefile:
+			tracefile = Tracefile(filename)
+			if tracefile.correct_key is None:
+				raise Exception("%s does not contain the key it was recorded with; profiling requires known keys." % (filename))
+			(samples, trace_count, sample_count) = tracefile.sample_matrix()
+			keys = bytes(tracefile.correct_key) * trace_count
+			plaintexts = b"".join(bytes(trace["plaintext"]) for trace in tracefile)
+			source = { "tracefile": tracefile.digest(), "trace_count": trace_count }
+			yield (samples, sample_count, sample_count, trace_count, keys, plaintexts, source)
+
+	def _batches(self):
+		if len(self._args.tracefile) > 0:
+			return self._tracefile_batches()
+		elif self._args.trace_count > 0:
+			return self._simulated_batches()
+		else:
+			# Only merging
+			return iter([ ])
+
+	@staticmethod
+	def _sbox_outputs(keys, plaintexts, i, trace_count):
+		return array.array("B", (DPAAttack._AES_SBOX[plaintexts[(16 * t) + i] ^ keys[(16 * t) + i]] for t in range(trace_count)))
+
+	def _select_pois(self):
+		# First pass: class means of the S-box output of every keybyte over
+		# the whole trace; the samples whose class means vary the most (sum of
+		# squared differences to the overall mean) are the points of interest
+		class_sums = None
+		class_counts = DPAKernels.zeros("I", 16 * DPAKernels.CLASS_COUNT)
+		for (samples, sample_stride, trace_length, trace_count, keys, plaintexts, source) in self._batches():
+			if self._sample_count is None:
+				self._sample_count = trace_length
+				class_sums = DPAKernels.zeros("d", 16 * DPAKernels.CLASS_COUNT * self._sample_count)
+			elif trace_length < self._sample_count:
+				raise Exception("Traces have different lengths (%d and %d samples)." % (self._sample_count, trace_length))
+			points = DPAKernels.gather(samples, sample_stride, trace_count, column_count = self._sample_count)
+			classes = array.array("I", ((i * DPAKernels.CLASS_COUNT) + DPAAttack._AES_SBOX[plaintexts[(16 * t) + i] ^ keys[(16 * t) + i]] for t in range(trace_count) for i in range(16)))
+			DPAKernels.accumulate_classes(points, self._sample_count, classes, 16, trace_count, class_sums, class_counts, thread_count = self._args.threads)
+		if self._sample_count is None:
+			raise Exception("No profiling traces to select points of interest from.")
+
+		L = self._sample_count
+		pois = [ ]
+		for i in range(16):
+			offset = i * DPAKernels.CLASS_COUNT
+			total_count = sum(class_counts[offset : offset + DPAKernels.CLASS_COUNT])
+			sosd = [ 0 ] * L
+			overall_sum = [ 0 ] * L
+			for c in range(DPAKernels.CLASS_COUNT):
+				count = class_counts[offset + c]
+				if count == 0:
+					continue
+				row = class_sums[(offset + c) * L : (offset + c + 1) * L]
+				for s in range(L):
+					sosd[s] += row[s] * row[s] / count
+					overall_sum[s] += row[s]
+			for s in range(L):
+				sosd[s] -= overall_sum[s] * overall_sum[s] / total_count
+
+			byte_pois = [ ]
+			for s in sorted(range(L), key = lambda s: sosd[s], reverse = True):
+				if all(abs(s - poi) >= self._args.poi_spacing for poi in byte_pois):
+					byte_pois.append(s)
+					if len(byte_pois) == self._args.poi_count:
+						break
+			pois.append(sorted(byte_pois))
+			if self._args.verbose >= 1:
+				print("Keybyte %2d: points of interest %s" % (i, ", ".join(str(poi) for poi in byte_pois)), file = sys.stderr)
+		return pois
+
+	def run(self):
+		merged = [ Templates.read(filename) for filename in self._args.merge ]
+		if self._args.pois is not None:
+			pois = Templates.read(self._args.pois).pois
+		elif len(merged) > 0:
+			pois = merged[0].pois
+		else:
+			pois = self._select_pois()
+		templates = Templates(pois)
+		for other in merged:
+			templates.merge(other)
+
+		# Second pass: class sums and scatter matrix of the POIs
+		for (samples, sample_stride, trace_length, trace_count, keys, plaintexts, source) in self._batches():
+			if trace_length < templates.sample_count:
+				raise Exception("Traces of %d samples do not cover all points of interest." % (trace_length))
+			for i in range(16):
+				points = DPAKernels.gather(samples, sample_stride, trace_count, columns = pois[i])
+				templates.accumulate(i, points, self._sbox_outputs(keys, plaintexts, i, trace_count), trace_count, thread_count = self._args.threads)
+			templates.add_traces(trace_count, source)
+			if self._args.verbose >= 1:
+				print("Profiled %d traces" % (templates.trace_count), file = sys.stderr)
+
+		for i in range(16):
+			unprofiled = templates.class_counts(i).tolist().count(0)
+			if unprofiled > 0:
+				print("Warning: %d S-box outputs of keybyte %d were never profiled; use more traces." % (unprofiled, i), file = sys.stderr)
+		templates.write(self._args.output)
+
+parser = FriendlyArgumentParser(description = "Build templates of the first round S-box output for a profiled template attack.")
+parser.add_argument("-n", "--trace-count", metavar = "count", type = int, help = "Number of traces to simulate for profiling. Defaults to 20000, or to 0 when templates are merged (-u) so that only the merge is done.")
+parser.add_argument("-b", "--batch-size", metavar = "count", type = int, default = 1000, help = "Number of traces simulated and accumulated at once. Defaults to %(default)d.")
+parser.add_argument("-s", "--seed", metavar = "value", type = int, default = 1234, help = "Seed for the random keys, plaintexts and masks of simulated traces. Every profiling run whose templates are to be merged needs a different seed. Defaults to %(default)d.")
+parser.add_argument("-f", "--firmware", metavar = "filename", help = "Firmware image to simulate. Defaults to the aes128_rom.bin of the simulator.")
+parser.add_argument("-l", "--max-trace-length", metavar = "samples", type = int, default = 32 * 1024, help = "Maximum number of samples of a simulated trace. Defaults to %(default)d.")
+parser.add_argument("-r", "--track-ram", action = "store_true", help = "Only scan the RAM words that the reference trace changed when simulating. Much faster, but not exact; see the -r option of trace_simulator.")
+parser.add_argument("-p", "--poi-count", metavar = "count", type = int, default = 8, help = "Number of points of interest per keybyte. Defaults to %(default)d.")
+parser.add_argument("-d", "--poi-spacing", metavar = "samples", type = int, default = 1, help = "Minimum distance of two points of interest of the same keybyte. Defaults to %(default)d.")
+parser.add_argument("-P", "--pois", metavar = "filename", help = "Reuse the points of interest of these templates instead of selecting them, e.g., to profile in several runs and merge the results. Merged templates provide them as well.")
+parser.add_argument("-u", "--merge", metavar = "filename", action = "append", default = [ ], help = "Merge the templates in this file, e.g., profiled on a different machine with the same points of interest. Can be specified multiple times.")
+parser.add_argument("-t", "--tracefile", metavar = "filename", action = "append", default = [ ], help = "Profile on this tracefile instead of simulating traces; its key must be known. Can be specified multiple times, e.g., for tracefiles recorded with different keys.")
+parser.add_argument("-T", "--threads", metavar = "count", type = int, help = "Number of threads used for the native kernels. Defaults to the number of available CPUs.")
+parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
+parser.add_argument("output", metavar = "templates", help = "File the templates are written to.")
+
+if __name__ == "__main__":
+	args = parser.parse_args(sys.argv[1:])
+	if not 1 <= args.poi_count <= 256:
+		parser.error("The number of points of interest must be between 1 and 256.")
+	if args.trace_count is None:
+		args.trace_count = 0 if (len(args.merge) > 0) else 20000
+	TemplateProfile(args).run()
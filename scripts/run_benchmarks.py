@@ -0,0 +1,165 @@
+#!/usr/bin/python3
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+import os
+import sys
+import json
+import time
+import socket
+import datetime
+import tempfile
+import subprocess
+sys.path.insert(0, os.path.dirname(os.path.realpath(__file__)) + "/../recovery")
+from FriendlyArgumentParser import FriendlyArgumentParser
+
+class BenchmarkRunner():
+	_BENCH_KEY = "a617db75310a5f1cc7241bfcd9cb93e0"
+	_BENCH_SEED = 1234
+
+	def __init__(self, args):
+		self._args = args
+		self._basedir = os.path.realpath(os.path.dirname(os.path.realpath(__file__)) + "/..")
+		self._results = [ ]
+
+	def _log(self, msg):
+		if self._args.verbose >= 1:
+			print(msg, file = sys.stderr)
+
+	def _git_revision(self):
+		try:
+			return subprocess.check_output([ "git", "-C", self._basedir, "describe", "--always", "--dirty" ], stderr = subprocess.DEVNULL).decode().strip()
+		except (OSError, subprocess.CalledProcessError):
+			return None
+
+	def _make_bench(self, subdir):
+		self._log("Running 'make bench' in %s" % (subdir))
+		try:
+			output = subprocess.check_output([ "make", "-s", "-C", self._basedir + "/" + subdir, "bench" ])
+		except subprocess.CalledProcessError as e:
+			self._results.append({ "benchmark": subdir, "skipped": "make bench failed with status %d" % (e.returncode) })
+			return
+		for line in output.decode().split("\n"):
+			if line.startswith("{"):
+				self._results.append(json.loads(line))
+
+	def _bench_simulator(self):
+		simulator_dir = self._basedir + "/simulator"
+		try:
+			subprocess.check_call([ "make", "-s", "-C", simulator_dir, "trace_simulator" ], stdout = subprocess.DEVNULL)
+		except subprocess.CalledProcessError as e:
+			self._results.append({ "benchmark": "trace_simulator", "skipped": "could not build trace_simulator (status %d)" % (e.returncode) })
+			return
+
+		with tempfile.TemporaryDirectory(prefix = "dpa_bench_sim_") as tmpdir:
+			self._log("Running trace_simulator for %d traces" % (self._args.simulator_traces))
+			t0 = time.time()
+			subprocess.check_call([ "./trace_simulator", "-s", str(self._BENCH_SEED), "-k", self._BENCH_KEY, "-n", str(self._args.simulator_traces), tmpdir ], cwd = simulator_dir, stdout = subprocess.DEVNULL)
+			runtime = time.time() - t0
+
+			# One sample is written per emulated instruction; the output
+			# directory also holds the sample map
+			instructions = sum(os.stat(tmpdir + "/" + filename).st_size for filename in os.listdir(tmpdir) if filename.startswith("trace_") and filename.endswith(".bin"))
+			self._results.append({
+				"benchmark":			"trace_simulator",
+				"seed":					self._BENCH_SEED,
+				"traces":				self._args.simulator_traces,
+				"instructions":			instructions,
+				"runtime_secs":			runtime,
+				"traces_per_sec":		self._args.simulator_traces / runtime,
+				"instructions_per_sec":	instructions / runtime,
+			})
+
+	def _bench_attack(self):
+		self._log("Running DPA attack benchmark")
+		cmd = [ self._basedir + "/recovery/dpa_benchmark.py", "-s", str(self._BENCH_SEED) ]
+		for trace_count in self._args.attack_traces:
+			cmd += [ "-n", str(trace_count) ]
+		output = subprocess.check_output(cmd, cwd = self._basedir + "/recovery")
+		self._results += json.loads(output)
+
+	@staticmethod
+	def _result_id(result):
+		return (result["benchmark"], result.get("trace_count"))
+
+	def compare(self, baseline_filename):
+		with open(baseline_filename) as f:
+			baseline = { self._result_id(result): result for result in json.load(f)["results"] }
+
+		regressions = [ ]
+		for result in self._results:
+			reference = baseline.get(self._result_id(result))
+			if reference is None:
+				continue
+			for (name, value) in result.items():
+				if (not name.endswith("_per_sec")) or (name not in reference):
+					continue
+				if reference[name] == 0:
+					print("%-24s %-8s %-22s no reference value, skipped" % (result["benchmark"], result.get("trace_count", ""), name), file = sys.stderr)
+					continue
+				ratio = value / reference[name]
+				status = "REGRESSION" if (ratio < 1 - (self._args.tolerance / 100)) else "ok"
+				print("%-24s %-8s %-22s %14.1f -> %14.1f  %+6.1f%%  %s" % (result["benchmark"], result.get("trace_count", ""), name, reference[name], value, (ratio - 1) * 100, status), file = sys.stderr)
+				if status != "ok":
+					regressions.append((result["benchmark"], name))
+		return regressions
+
+	def run(self):
+		self._make_bench("aes128")
+		self._make_bench("simulator")
+		if not self._args.no_simulator:
+			self._bench_simulator()
+		self._bench_attack()
+		return {
+			"meta": {
+				"created":	datetime.datetime.utcnow().strftime("%Y-%m-%dT%H:%M:%SZ"),
+				"host":		socket.gethostname(),
+				"revision":	self._git_revision(),
+				"cc":		os.environ.get("CC", "cc"),
+				"cflags":	os.environ.get("CFLAGS", ""),
+			},
+			"results": self._results,
+		}
+
+parser = FriendlyArgumentParser(description = "Run the reproducible benchmark suite (simulator, AES and DPA attack) and emit JSON results.")
+parser.add_argument("-n", "--simulator-traces", metavar = "count", type = int, default = 200, help = "Number of traces to simulate for measuring simulator throughput. Defaults to %(default)d.")
+parser.add_argument("-a", "--attack-traces", metavar = "count", type = int, action = "append", default = [ ], help = "Dataset size for the end-to-end attack benchmark. Can be specified multiple times. Defaults to 250, 500 and 1000.")
+parser.add_argument("-S", "--no-simulator", action = "store_true", help = "Do not benchmark trace_simulator (e.g., when libthumb2sim is unavailable).")
+parser.add_argument("-c", "--compare", metavar = "baseline_json", help = "Compare throughput figures against this previous result file and exit with an error if any regressed.")
+parser.add_argument("-t", "--tolerance", metavar = "percent", type = float, default = 10, help = "Throughput loss relative to the baseline that is still tolerated before flagging a regression. Defaults to %(default).0f%%.")
+parser.add_argument("-o", "--output", metavar = "filename", help = "Write JSON results to this file. By default, they are printed on stdout.")
+parser.add_argument("-v", "--verbose", action = "count", default = 0, help = "Increases verbosity. Can be specified multiple times to increase.")
+args = parser.parse_args(sys.argv[1:])
+
+runner = BenchmarkRunner(args)
+results = runner.run()
+if args.output is None:
+	print(json.dumps(results, indent = 4))
+else:
+	with open(args.output, "w") as f:
+		json.dump(results, f, indent = 4)
+		print(file = f)
+
+if args.compare is not None:
+	regressions = runner.compare(args.compare)
+	if len(regressions) > 0:
+		print("%d benchmark figure(s) regressed by more than %.0f%%." % (len(regressions), args.tolerance), file = sys.stderr)
+		sys.exit(1)
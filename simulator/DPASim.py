@@ -0,0 +1,138 @@
+#	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+#	Copyright (C) 2022-2022 Johannes Bauer
+#
+#	This file is part of dpa-simulator.
+#
+#	dpa-simulator is free software; you can redistribute it and/or modify
+#	it under the terms of the GNU General Public License as published by
+#	the Free Software Foundation; this program is ONLY licensed under
+#	version 3 of the License, later versions are explicitly excluded.
+#
+#	dpa-simulator is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU General Public License for more details.
+#
+#	You should have received a copy of the GNU General Public License
+#	along with dpa-simulator; if not, write to the Free Software
+#	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+#	Johannes Bauer <JohannesBauer@gmx.de>
+
+
+import os
+import ctypes
+import array
+
+# Thin ctypes binding for libdpasim.so (build it with "make" in this
+# directory). Traces are emulated in-process and written straight into
+# caller-provided array.array buffers. One instance wraps one emulator
+# context; threads that generate traces in parallel need one instance each.
+class DPASim():
+	KEY_LENGTH = 16
+	BLOCK_LENGTH = 16
+	DEFAULT_MAX_TRACE_LENGTH = 32 * 1024
+
+	_lib = None
+
+	@classmethod
+	def _library(cls):
+		if cls._lib is None:
+			filename = os.path.dirname(os.path.realpath(__file__)) + "/libdpasim.so"
+			if not os.path.isfile(filename):
+				raise Exception("%s not found; run 'make' in the simulator/ directory first." % (filename))
+			lib = ctypes.CDLL(filename)
+			lib.dpasim_init.restype = ctypes.c_void_p
+			lib.dpasim_init.argtypes = [ ctypes.c_char_p ]
+			lib.dpasim_set_ram_tracking.restype = None
+			lib.dpasim_set_ram_tracking.argtypes = [ ctypes.c_void_p, ctypes.c_bool ]
+			lib.dpasim_generate.restype = ctypes.c_bool
+			lib.dpasim_generate.argtypes = [ ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p ]
+			lib.dpasim_sample_map.restype = ctypes.c_uint
+			lib.dpasim_sample_map.argtypes = [ ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint ]
+			lib.dpasim_free.restype = None
+			lib.dpasim_free.argtypes = [ ctypes.c_void_p ]
+			cls._lib = lib
+		return cls._lib
+
+	def __init__(self, firmware_filename = None, track_ram = False):
+		if firmware_filename is None:
+			firmware_filename = os.path.dirname(os.path.realpath(__file__)) + "/aes128_rom.bin"
+		self._ctx = self._library().dpasim_init(firmware_filename.encode())
+		if self._ctx is None:
+			raise Exception("Unable to initialize emulator with %s." % (firmware_filename))
+		# Scanning only the RAM words the reference trace changed is much
+		# faster, but not exact; see dpasim_set_ram_tracking()
+		self._library().dpasim_set_ram_tracking(self._ctx, track_ram)
+
+	def close(self):
+		if self._ctx is not None:
+			self._library().dpasim_free(self._ctx)
+			self._ctx = None
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		self.close()
+
+	@staticmethod
+	def _ptr(buf, typecode):
+		if buf is None:
+			return None
+		if buf.typecode != typecode:
+			raise TypeError("Expected array of type '%s', but got '%s'." % (typecode, buf.typecode))
+		return buf.buffer_info()[0]
+
+	@staticmethod
+	def _byte_array(data):
+		if isinstance(data, array.array) and (data.typecode == "B"):
+			return data
+		return array.array("B", data)
+
+	@staticmethod
+	def zeros(typecode, length):
+		return array.array(typecode, bytes(array.array(typecode).itemsize * length))
+
+	def generate(self, keys, plaintexts, randomness = None, sample_stride = DEFAULT_MAX_TRACE_LENGTH, samples = None, trace_lengths = None, ciphertexts = None):
+		# keys is either a single key for all traces or one key per trace;
+		# plaintexts and randomness hold 16 bytes per trace. Samples of trace
+		# i end up at samples[i * sample_stride]. Preallocated output arrays
+		# may be given to avoid any allocation, otherwise they are created.
+		# Returns (samples, trace_lengths, ciphertexts).
+		trace_count = len(plaintexts) // self.BLOCK_LENGTH
+		keys = self._byte_array(keys)
+		if len(keys) == self.KEY_LENGTH:
+			key_stride = 0
+		elif len(keys) == self.KEY_LENGTH * trace_count:
+			key_stride = self.KEY_LENGTH
+		else:
+			raise ValueError("Expected one key or %d keys, but got %d bytes of key material." % (trace_count, len(keys)))
+		plaintexts = self._byte_array(plaintexts)
+		if randomness is not None:
+			randomness = self._byte_array(randomness)
+			if len(randomness) != self.BLOCK_LENGTH * trace_count:
+				raise ValueError("Expected %d bytes of randomness, but got %d." % (self.BLOCK_LENGTH * trace_count, len(randomness)))
+
+		if samples is None:
+			samples = self.zeros("B", trace_count * sample_stride)
+		if trace_lengths is None:
+			trace_lengths = self.zeros("I", trace_count)
+		if ciphertexts is None:
+			ciphertexts = self.zeros("B", self.BLOCK_LENGTH * trace_count)
+		if (len(samples) < trace_count * sample_stride) or (len(trace_lengths) < trace_count) or (len(ciphertexts) < self.BLOCK_LENGTH * trace_count):
+			raise ValueError("Output buffers too small for %d traces." % (trace_count))
+
+		complete = self._library().dpasim_generate(self._ctx, self._ptr(keys, "B"), key_stride, self._ptr(plaintexts, "B"), self._ptr(randomness, "B"), trace_count, self._ptr(samples, "B"), sample_stride, self._ptr(trace_lengths, "I"), self._ptr(ciphertexts, "B"))
+		if not complete:
+			raise Exception("Traces exceed the sample stride of %d samples." % (sample_stride))
+		return (samples, trace_lengths, ciphertexts)
+
+	def sample_map(self):
+		# Run-length encoded instruction address of every sample as a list of
+		# (sample_start, count, pc_start, pc_stride); available once at least
+		# one trace has been generated
+		entry_count = self._library().dpasim_sample_map(self._ctx, None, 0)
+		entries = self.zeros("I", 4 * entry_count)
+		self._library().dpasim_sample_map(self._ctx, self._ptr(entries, "I"), entry_count)
+		return [ (entries[4 * i], entries[4 * i + 1], entries[4 * i + 2], ctypes.c_int32(entries[4 * i + 3]).value) for i in range(entry_count) ]
@@ -24,6 +24,8 @@ static const char *option_texts[] = {
 	[ARG_FIRMWARE] = "-f / --firmware",
 	[ARG_TRACECNT] = "-n / --tracecnt",
 	[ARG_KEY] = "-k / --key",
+	[ARG_SEED] = "-s / --seed",
+	[ARG_TRACK_RAM] = "-r / --track-ram",
 	[ARG_OUTPUT_DIRECTORY] = "output_directory",
 };
 
@@ -31,10 +33,14 @@ enum argparse_option_internal_t {
 	ARG_FIRMWARE_SHORT = 'f',
 	ARG_TRACECNT_SHORT = 'n',
 	ARG_KEY_SHORT = 'k',
+	ARG_SEED_SHORT = 's',
+	ARG_TRACK_RAM_SHORT = 'r',
 	ARG_FIRMWARE_LONG = 1000,
 	ARG_TRACECNT_LONG = 1001,
 	ARG_KEY_LONG = 1002,
-	ARG_OUTPUT_DIRECTORY_LONG = 1003,
+	ARG_SEED_LONG = 1003,
+	ARG_TRACK_RAM_LONG = 1004,
+	ARG_OUTPUT_DIRECTORY_LONG = 1005,
 };
 
 static void errmsg_callback(const char *errmsg, ...) {
@@ -55,11 +61,13 @@ static void errmsg_option_callback(enum argparse_option_t error_option, const ch
 
 bool argparse_parse(int argc, char **argv, argparse_callback_t argument_callback, argparse_plausibilization_callback_t plausibilization_callback) {
 	last_parsed_option = ARGPARSE_NO_OPTION;
-	const char *short_options = "f:n:k:";
+	const char *short_options = "f:n:k:s:r";
 	struct option long_options[] = {
 		{ "firmware",                         required_argument, 0, ARG_FIRMWARE_LONG },
 		{ "tracecnt",                         required_argument, 0, ARG_TRACECNT_LONG },
 		{ "key",                              required_argument, 0, ARG_KEY_LONG },
+		{ "seed",                             required_argument, 0, ARG_SEED_LONG },
+		{ "track-ram",                        no_argument, 0, ARG_TRACK_RAM_LONG },
 		{ "output_directory",                 required_argument, 0, ARG_OUTPUT_DIRECTORY_LONG },
 		{ 0 }
 	};
@@ -96,6 +104,22 @@ bool argparse_parse(int argc, char **argv, argparse_callback_t argument_callback
 				}
 				break;
 
+			case ARG_SEED_SHORT:
+			case ARG_SEED_LONG:
+				last_parsed_option = ARG_SEED;
+				if (!argument_callback(ARG_SEED, optarg, errmsg_callback)) {
+					return false;
+				}
+				break;
+
+			case ARG_TRACK_RAM_SHORT:
+			case ARG_TRACK_RAM_LONG:
+				last_parsed_option = ARG_TRACK_RAM;
+				if (!argument_callback(ARG_TRACK_RAM, optarg, errmsg_callback)) {
+					return false;
+				}
+				break;
+
 			default:
 				last_parsed_option = ARGPARSE_NO_OPTION;
 				errmsg_callback("unrecognized option supplied");
@@ -125,7 +149,7 @@ bool argparse_parse(int argc, char **argv, argparse_callback_t argument_callback
 }
 
 void argparse_show_syntax(void) {
-	fprintf(stderr, "usage: trace_simulator [-f filename] [-n count] [-k key] path\n");
+	fprintf(stderr, "usage: trace_simulator [-f filename] [-n count] [-k key] [-s seed] [-r] path\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Emulates embedded code and simulates power traces.\n");
 	fprintf(stderr, "\n");
@@ -140,6 +164,13 @@ void argparse_show_syntax(void) {
 	fprintf(stderr, "                        Defaults to 1000.\n");
 	fprintf(stderr, "  -k key, --key key     Gives the key to feed the implementation. By default the key is entirely\n");
 	fprintf(stderr, "                        zeros.\n");
+	fprintf(stderr, "  -s seed, --seed seed  Seed the plaintext generator with this integer value to get a reproducible\n");
+	fprintf(stderr, "                        set of traces. By default, plaintexts are read from /dev/urandom.\n");
+	fprintf(stderr, "  -r, --track-ram       Only scan the RAM words that the reference trace changed instead of all RAM\n");
+	fprintf(stderr, "                        for every instruction. Much faster, but a word that is changed and restored\n");
+	fprintf(stderr, "                        within one instruction window goes unnoticed; tracked traces are\n");
+	fprintf(stderr, "                        periodically compared to a full scan and tracking is switched off when they\n");
+	fprintf(stderr, "                        differ.\n");
 }
 
 void argparse_parse_or_quit(int argc, char **argv, argparse_callback_t argument_callback, argparse_plausibilization_callback_t plausibilization_callback) {
@@ -167,6 +198,8 @@ static const char *option_enum_to_str(enum argparse_option_t option) {
 		case ARG_FIRMWARE: return "ARG_FIRMWARE";
 		case ARG_TRACECNT: return "ARG_TRACECNT";
 		case ARG_KEY: return "ARG_KEY";
+		case ARG_SEED: return "ARG_SEED";
+		case ARG_TRACK_RAM: return "ARG_TRACK_RAM";
 		case ARG_OUTPUT_DIRECTORY: return "ARG_OUTPUT_DIRECTORY";
 	}
 	return "UNKNOWN";
@@ -23,7 +23,9 @@ enum argparse_option_t {
 	ARG_FIRMWARE = 2,
 	ARG_TRACECNT = 3,
 	ARG_KEY = 4,
-	ARG_OUTPUT_DIRECTORY = 5,
+	ARG_SEED = 5,
+	ARG_TRACK_RAM = 6,
+	ARG_OUTPUT_DIRECTORY = 7,
 };
 
 typedef void (*argparse_errmsg_callback_t)(const char *errmsg, ...);
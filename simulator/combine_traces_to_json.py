@@ -47,5 +47,11 @@ for filename in os.listdir(args.input_directory):
 		}
 		tracefile["traces"].append(trace)
 
+# The simulator writes the sample to instruction map once per directory
+sample_map_filename = args.input_directory + "/sample_map.json"
+if os.path.isfile(sample_map_filename):
+	with open(sample_map_filename) as f:
+		tracefile["meta"]["sample_map"] = json.load(f)["entries"]
+
 with open(args.output_json, "w") as f:
 	json.dump(tracefile, f)
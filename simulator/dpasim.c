@@ -0,0 +1,443 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <thumb2sim/thumb2sim.h>
+#include "dpasim.h"
+#include "leakage.h"
+
+#define RAM_WORDS					(DPASIM_RAM_SIZE_KB * 1024 / 4)
+#define REG_PC						15
+#define VERIFY_INTERVAL				64
+
+struct word_range_t {
+	uint32_t start;
+	uint32_t length;
+};
+
+struct dpasim_ctx_t {
+	struct emu_ctx_t *emu_ctx;
+
+	/* The control flow of the leakage window usually does not depend on the
+	 * data, so the first trace is emulated with a full RAM scan and serves
+	 * as a reference: it records the PC of every step and which RAM words
+	 * change at all. Following traces only scan those words. A trace whose
+	 * PCs diverge from the reference or that changed other words is emulated
+	 * again with a full scan and becomes the new reference. A word outside
+	 * of the tracked ranges that is changed and restored within the window
+	 * goes unnoticed, though, so tracking is only used when enabled with
+	 * dpasim_set_ram_tracking(). Even then, every VERIFY_INTERVAL-th tracked
+	 * trace is emulated again with a full scan and compared; on any
+	 * difference, tracking is switched off for good. */
+	bool have_reference;
+	bool recording_reference;
+	bool tracking_enabled;
+	bool tracking;
+	uint32_t traces_since_verification;
+	uint8_t *verify_samples;
+	size_t verify_capacity;
+	bool diverged;
+	bool reference_mismatch;
+	uint32_t step;
+	uint32_t *reference_pcs;
+	uint32_t reference_length;
+	uint32_t reference_capacity;
+	struct word_range_t *ranges;
+	unsigned int range_count;
+	uint64_t dirty_words[RAM_WORDS / 64];
+
+	/* State of the trace that is currently emulated */
+	bool end_emulation;
+	int readstate;
+	int writestate;
+	const uint8_t *key;
+	const uint8_t *plaintext;
+	const uint8_t *randomness;
+	uint8_t *ciphertext;
+	uint8_t *samples;
+	size_t sample_capacity;
+	uint32_t trace_length;
+	bool truncated;
+	struct cm3_cpu_state_t prev_regs;
+	uint32_t prev_ram[RAM_WORDS];
+};
+
+#define READSTATE_READ_KEY			1
+#define READSTATE_READ_PLAINTEXT	2
+#define READSTATE_READ_RANDOMNESS	3
+
+#define WRITESTATE_WRITE_KEY		1
+#define WRITESTATE_WRITE_PLAINTEXT	2
+#define WRITESTATE_WRITE_CIPHERTEXT	3
+
+#define BREAKPOINT_START_AES		1
+#define BREAKPOINT_END_AES			2
+
+static unsigned int scan_ram_recording(struct dpasim_ctx_t *ctx, const uint32_t *now_ram) {
+	unsigned int bits_flipped = 0;
+	for (unsigned int i = 0; i < RAM_WORDS; i++) {
+		const uint32_t flipped = ctx->prev_ram[i] ^ now_ram[i];
+		if (flipped) {
+			bits_flipped += hweight(flipped);
+			ctx->dirty_words[i / 64] |= 1ULL << (i % 64);
+			ctx->prev_ram[i] = now_ram[i];
+		}
+	}
+	return bits_flipped;
+}
+
+static unsigned int scan_ram_ranges(struct dpasim_ctx_t *ctx, const uint32_t *now_ram) {
+	unsigned int bits_flipped = 0;
+	for (unsigned int i = 0; i < ctx->range_count; i++) {
+		const struct word_range_t *range = &ctx->ranges[i];
+		bits_flipped += leakage_hamming_distance(ctx->prev_ram + range->start, now_ram + range->start, range->length);
+		memcpy(ctx->prev_ram + range->start, now_ram + range->start, range->length * sizeof(uint32_t));
+	}
+	return bits_flipped;
+}
+
+static void record_reference_pc(struct dpasim_ctx_t *ctx, uint32_t pc) {
+	if (ctx->reference_length == ctx->reference_capacity) {
+		const uint32_t capacity = ctx->reference_capacity ? (2 * ctx->reference_capacity) : 4096;
+		uint32_t *pcs = realloc(ctx->reference_pcs, capacity * sizeof(uint32_t));
+		if (!pcs) {
+			/* Without a complete reference, every trace scans all RAM */
+			ctx->recording_reference = false;
+			return;
+		}
+		ctx->reference_pcs = pcs;
+		ctx->reference_capacity = capacity;
+	}
+	ctx->reference_pcs[ctx->reference_length++] = pc;
+}
+
+static void start_reference(struct dpasim_ctx_t *ctx) {
+	/* The changed words of previous references are kept, so the tracked
+	 * ranges only ever grow */
+	ctx->recording_reference = true;
+	ctx->reference_length = 0;
+}
+
+static void finish_reference(struct dpasim_ctx_t *ctx) {
+	/* Merge the changed words into contiguous ranges */
+	unsigned int range_count = 0;
+	for (unsigned int i = 0; i < RAM_WORDS; i++) {
+		const bool dirty = (ctx->dirty_words[i / 64] >> (i % 64)) & 1;
+		const bool prev_dirty = (i > 0) && ((ctx->dirty_words[(i - 1) / 64] >> ((i - 1) % 64)) & 1);
+		if (dirty && !prev_dirty) {
+			range_count++;
+		}
+	}
+	struct word_range_t *ranges = malloc((range_count ? range_count : 1) * sizeof(struct word_range_t));
+	if (!ranges) {
+		ctx->recording_reference = false;
+		return;
+	}
+	range_count = 0;
+	for (unsigned int i = 0; i < RAM_WORDS; i++) {
+		if ((ctx->dirty_words[i / 64] >> (i % 64)) & 1) {
+			if ((range_count > 0) && (ranges[range_count - 1].start + ranges[range_count - 1].length == i)) {
+				ranges[range_count - 1].length++;
+			} else {
+				ranges[range_count++] = (struct word_range_t){ .start = i, .length = 1 };
+			}
+		}
+	}
+	free(ctx->ranges);
+	ctx->ranges = ranges;
+	ctx->range_count = range_count;
+	ctx->recording_reference = false;
+	ctx->have_reference = true;
+}
+
+static void post_step_callback(struct emu_ctx_t *emu_ctx) {
+	struct dpasim_ctx_t *ctx = (struct dpasim_ctx_t*)emu_ctx->user;
+
+	/* The PC before the step is the address of the executed instruction */
+	const uint32_t pc = ctx->prev_regs.reg[REG_PC];
+	unsigned int bits_flipped_regs = leakage_hamming_distance(ctx->prev_regs.reg, emu_ctx->cpu.reg, 16);
+	memcpy(&ctx->prev_regs, &emu_ctx->cpu, sizeof(struct cm3_cpu_state_t));
+
+	const uint32_t *now_ram = (uint32_t*)emu_ctx->addr_space.slices[1].data;
+	if (ctx->recording_reference) {
+		bits_flipped_regs += scan_ram_recording(ctx, now_ram);
+		record_reference_pc(ctx, pc);
+	} else if (ctx->tracking && !ctx->diverged && (ctx->step < ctx->reference_length) && (ctx->reference_pcs[ctx->step] == pc)) {
+		bits_flipped_regs += scan_ram_ranges(ctx, now_ram);
+	} else {
+		ctx->diverged = true;
+		bits_flipped_regs += leakage_hamming_distance(ctx->prev_ram, now_ram, RAM_WORDS);
+		memcpy(ctx->prev_ram, now_ram, sizeof(ctx->prev_ram));
+	}
+	ctx->step++;
+
+	if (bits_flipped_regs > 255) {
+		fprintf(stderr, "Register hamming weight clipped from %d\n", bits_flipped_regs);
+		bits_flipped_regs = 255;
+	}
+
+	if (ctx->trace_length < ctx->sample_capacity) {
+		ctx->samples[ctx->trace_length] = bits_flipped_regs;
+		ctx->trace_length++;
+	} else {
+		ctx->truncated = true;
+	}
+}
+
+static void bkpt_callback(struct emu_ctx_t *emu_ctx, uint8_t bkpt_number) {
+	struct dpasim_ctx_t *ctx = (struct dpasim_ctx_t*)emu_ctx->user;
+	if (bkpt_number == BREAKPOINT_START_AES) {
+		emu_ctx->post_step_callback = post_step_callback;
+		memcpy(&ctx->prev_regs, &emu_ctx->cpu, sizeof(struct cm3_cpu_state_t));
+		memcpy(ctx->prev_ram, emu_ctx->addr_space.slices[1].data, DPASIM_RAM_SIZE_KB * 1024);
+		ctx->step = 0;
+		ctx->diverged = false;
+		if (!ctx->have_reference) {
+			start_reference(ctx);
+		}
+		ctx->tracking = ctx->have_reference && ctx->tracking_enabled;
+	} else if (bkpt_number == BREAKPOINT_END_AES) {
+		emu_ctx->post_step_callback = NULL;
+		if (ctx->recording_reference) {
+			finish_reference(ctx);
+		} else if (ctx->tracking) {
+			/* Changes of words outside of the tracked ranges would have been
+			 * missed and show up as a difference to the RAM contents at the
+			 * start of the window. Only a word that is changed and restored
+			 * within the window could still go unnoticed, which
+			 * verify_trace() checks for. */
+			if (ctx->diverged || (ctx->step != ctx->reference_length) || memcmp(ctx->prev_ram, emu_ctx->addr_space.slices[1].data, DPASIM_RAM_SIZE_KB * 1024)) {
+				ctx->reference_mismatch = true;
+			}
+		}
+	} else if (bkpt_number != 255) {
+		fprintf(stderr, "Unexpected breakpoint %d.\n", bkpt_number);
+	}
+}
+
+static uint32_t syscall_read(struct emu_ctx_t *emu_ctx, void *data, uint32_t max_length) {
+	struct dpasim_ctx_t *ctx = (struct dpasim_ctx_t*)emu_ctx->user;
+	ctx->readstate++;
+
+	if (ctx->readstate == READSTATE_READ_KEY) {
+		memcpy(data, ctx->key, 16);
+	} else if (ctx->readstate == READSTATE_READ_PLAINTEXT) {
+		memcpy(data, ctx->plaintext, 16);
+	} else if (ctx->readstate == READSTATE_READ_RANDOMNESS) {
+		/* Masked implementations fetch their fresh masks from here */
+		const unsigned int length = (max_length < 16) ? max_length : 16;
+		if (ctx->randomness) {
+			memcpy(data, ctx->randomness, length);
+		} else {
+			memset(data, 0, length);
+		}
+	} else {
+		fprintf(stderr, "Unexpected read %d\n", ctx->readstate);
+	}
+	return max_length;
+}
+
+static bool end_emulation_callback(struct emu_ctx_t *emu_ctx) {
+	struct dpasim_ctx_t *ctx = (struct dpasim_ctx_t*)emu_ctx->user;
+	return ctx->end_emulation;
+}
+
+static void syscall_write(struct emu_ctx_t *emu_ctx, const void *data, uint32_t length) {
+	struct dpasim_ctx_t *ctx = (struct dpasim_ctx_t*)emu_ctx->user;
+	ctx->writestate++;
+	if (ctx->writestate == WRITESTATE_WRITE_CIPHERTEXT) {
+		memcpy(ctx->ciphertext, data, 16);
+	}
+}
+
+static void syscall_exit(struct emu_ctx_t *emu_ctx, uint32_t status) {
+	struct dpasim_ctx_t *ctx = (struct dpasim_ctx_t*)emu_ctx->user;
+	ctx->end_emulation = true;
+}
+
+/* Loads the firmware once; the returned context can then generate any number
+ * of traces. Returns NULL if the emulator cannot be initialized. */
+struct dpasim_ctx_t *dpasim_init(const char *firmware_filename) {
+	struct dpasim_ctx_t *ctx = calloc(1, sizeof(struct dpasim_ctx_t));
+	if (!ctx) {
+		return NULL;
+	}
+
+	const struct hardware_params_t cpu_parameters = {
+		.rom_size_bytes = 1024 * 1024,
+		.ram_size_bytes = DPASIM_RAM_SIZE_KB * 1024,
+		.ivt_base_address = 0x08000000,
+		.rom_base_address = 0x08000000,
+		.ram_base_address = 0x20000000,
+		.rom_image_filename = firmware_filename,
+		.ram_image_filename = NULL,
+	};
+	ctx->emu_ctx = init_cortexm(&cpu_parameters);
+	if (!ctx->emu_ctx) {
+		free(ctx);
+		return NULL;
+	}
+	ctx->emu_ctx->user = ctx;
+	ctx->emu_ctx->bkpt_callback = bkpt_callback;
+	ctx->emu_ctx->end_emulation_callback = end_emulation_callback;
+	ctx->emu_ctx->emulator_syscall_read = syscall_read;
+	ctx->emu_ctx->emulator_syscall_write = syscall_write;
+	ctx->emu_ctx->emulator_syscall_exit = syscall_exit;
+	return ctx;
+}
+
+static void run_trace(struct dpasim_ctx_t *ctx) {
+	ctx->end_emulation = false;
+	ctx->readstate = 0;
+	ctx->writestate = 0;
+	ctx->trace_length = 0;
+	ctx->truncated = false;
+	ctx->reference_mismatch = false;
+	memset(ctx->ciphertext, 0, 16);
+	cpu_reset(ctx->emu_ctx);
+	cpu_run(ctx->emu_ctx);
+}
+
+static void verify_trace(struct dpasim_ctx_t *ctx) {
+	ctx->traces_since_verification = 0;
+	const uint32_t tracked_length = ctx->trace_length;
+	if (ctx->verify_capacity < tracked_length) {
+		uint8_t *verify_samples = realloc(ctx->verify_samples, tracked_length);
+		if (!verify_samples) {
+			/* Without verification, tracking cannot be trusted */
+			ctx->tracking_enabled = false;
+			ctx->have_reference = false;
+			run_trace(ctx);
+			return;
+		}
+		ctx->verify_samples = verify_samples;
+		ctx->verify_capacity = tracked_length;
+	}
+	memcpy(ctx->verify_samples, ctx->samples, tracked_length);
+
+	/* The full scan also records a new reference, which picks up any word
+	 * that was missed */
+	ctx->have_reference = false;
+	run_trace(ctx);
+	if ((ctx->trace_length != tracked_length) || memcmp(ctx->verify_samples, ctx->samples, tracked_length)) {
+		fprintf(stderr, "Tracked leakage scan differs from full scan; scanning all RAM from now on.\n");
+		ctx->tracking_enabled = false;
+	}
+}
+
+/* Tracking is off by default, so every instruction scans all of RAM. When
+ * enabled, traces only scan the words their reference trace changed, which is
+ * much faster but can miss a word that is changed and restored within one
+ * instruction window; tracked traces are periodically checked against a full
+ * scan and tracking switches itself off when they differ. */
+void dpasim_set_ram_tracking(struct dpasim_ctx_t *ctx, bool enabled) {
+	ctx->tracking_enabled = enabled;
+	ctx->traces_since_verification = 0;
+}
+
+/* Emulates trace_count encryptions. Trace i uses the 16 byte key at
+ * keys[i * key_stride] (a key_stride of zero uses the same key for all
+ * traces), plaintexts[16 * i] and, for masked firmware, 16 bytes of
+ * randomness[16 * i] (all-zero if randomness is NULL). Its samples are written
+ * to samples[i * sample_stride], of which at most sample_stride are recorded,
+ * its length to trace_lengths[i] and the ciphertext to ciphertexts[16 * i].
+ * trace_lengths and ciphertexts may be NULL. Returns false if any trace had to
+ * be truncated. */
+bool dpasim_generate(struct dpasim_ctx_t *ctx, const uint8_t *keys, size_t key_stride, const uint8_t *plaintexts, const uint8_t *randomness, unsigned int trace_count, uint8_t *samples, size_t sample_stride, uint32_t *trace_lengths, uint8_t *ciphertexts) {
+	bool complete = true;
+	uint8_t ciphertext[16];
+	for (unsigned int i = 0; i < trace_count; i++) {
+		ctx->key = keys + (i * key_stride);
+		ctx->plaintext = plaintexts + (16 * i);
+		ctx->randomness = randomness ? (randomness + (16 * i)) : NULL;
+		ctx->ciphertext = ciphertexts ? (ciphertexts + (16 * i)) : ciphertext;
+		ctx->samples = samples + (i * sample_stride);
+		ctx->sample_capacity = sample_stride;
+		run_trace(ctx);
+		if (ctx->reference_mismatch) {
+			ctx->have_reference = false;
+			run_trace(ctx);
+		} else if (ctx->tracking && (++ctx->traces_since_verification >= VERIFY_INTERVAL)) {
+			verify_trace(ctx);
+		}
+
+		if (ctx->truncated) {
+			complete = false;
+		}
+		if (trace_lengths) {
+			trace_lengths[i] = ctx->trace_length;
+		}
+	}
+	return complete;
+}
+
+/* Run-length encodes the instruction addresses of the reference trace, which
+ * are the same for every trace. Writes up to max_entries entries and returns
+ * the number of entries of the complete map, so it can be called with
+ * max_entries zero first to size the buffer. Returns zero while no reference
+ * trace has been emulated. */
+unsigned int dpasim_sample_map(const struct dpasim_ctx_t *ctx, struct dpasim_map_entry_t *entries, unsigned int max_entries) {
+	if (!ctx->have_reference) {
+		return 0;
+	}
+	unsigned int entry_count = 0;
+	struct dpasim_map_entry_t entry = { 0 };
+	for (uint32_t i = 0; i < ctx->reference_length; i++) {
+		const uint32_t pc = ctx->reference_pcs[i];
+		if (entry.count == 0) {
+			entry = (struct dpasim_map_entry_t){ .sample_start = i, .count = 1, .pc_start = pc, .pc_stride = 0 };
+		} else if (entry.count == 1) {
+			entry.pc_stride = (int32_t)(pc - entry.pc_start);
+			entry.count++;
+		} else if (pc == entry.pc_start + (uint32_t)(entry.pc_stride * (int32_t)entry.count)) {
+			entry.count++;
+		} else {
+			if (entry_count < max_entries) {
+				entries[entry_count] = entry;
+			}
+			entry_count++;
+			entry = (struct dpasim_map_entry_t){ .sample_start = i, .count = 1, .pc_start = pc, .pc_stride = 0 };
+		}
+	}
+	if (entry.count > 0) {
+		if (entry_count < max_entries) {
+			entries[entry_count] = entry;
+		}
+		entry_count++;
+	}
+	return entry_count;
+}
+
+void dpasim_free(struct dpasim_ctx_t *ctx) {
+	if (!ctx) {
+		return;
+	}
+	/* The emulator context created by init_cortexm() is not released, which
+	 * is bounded by the number of contexts and not by the number of traces */
+	free(ctx->reference_pcs);
+	free(ctx->ranges);
+	free(ctx->verify_samples);
+	free(ctx);
+}
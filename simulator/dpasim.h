@@ -0,0 +1,58 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#ifndef __DPASIM_H__
+#define __DPASIM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DPASIM_RAM_SIZE_KB		128
+
+/* One emulator instance with its own firmware image and leakage state. A
+ * context must only be used by one thread at a time; threads that generate
+ * traces in parallel each need their own context. */
+struct dpasim_ctx_t;
+
+/* Run of samples whose instructions lie at equidistant addresses: sample
+ * sample_start + k was produced by the instruction at pc_start + k *
+ * pc_stride for 0 <= k < count. Every sample corresponds to exactly one
+ * emulated instruction, so the sample index also is the cycle count relative
+ * to the start of the leakage window. */
+struct dpasim_map_entry_t {
+	uint32_t sample_start;
+	uint32_t count;
+	uint32_t pc_start;
+	int32_t pc_stride;
+};
+
+/*************** AUTO GENERATED SECTION FOLLOWS ***************/
+struct dpasim_ctx_t *dpasim_init(const char *firmware_filename);
+void dpasim_set_ram_tracking(struct dpasim_ctx_t *ctx, bool enabled);
+bool dpasim_generate(struct dpasim_ctx_t *ctx, const uint8_t *keys, size_t key_stride, const uint8_t *plaintexts, const uint8_t *randomness, unsigned int trace_count, uint8_t *samples, size_t sample_stride, uint32_t *trace_lengths, uint8_t *ciphertexts);
+unsigned int dpasim_sample_map(const struct dpasim_ctx_t *ctx, struct dpasim_map_entry_t *entries, unsigned int max_entries);
+void dpasim_free(struct dpasim_ctx_t *ctx);
+/***************  AUTO GENERATED SECTION ENDS   ***************/
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#include <stdint.h>
+#include "leakage.h"
+
+unsigned int hweight(uint32_t x) {
+	return __builtin_popcount(x);
+}
+
+/* Number of bits that flipped between two snapshots of the same memory
+ * (register set or SRAM), i.e., the Hamming distance leakage model. */
+unsigned int leakage_hamming_distance(const uint32_t *prev, const uint32_t *now, unsigned int word_count) {
+	unsigned int bits_flipped = 0;
+	for (unsigned int i = 0; i < word_count; i++) {
+		bits_flipped += hweight(prev[i] ^ now[i]);
+	}
+	return bits_flipped;
+}
@@ -0,0 +1,88 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "leakage.h"
+
+#define RAM_SIZE_KB				128
+#define BENCH_SEED				0x5eed1eac
+#define BENCH_MIN_RUNTIME_SECS	1.0
+
+static double now_secs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static uint32_t prng_next(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* Measures the full scan leakage kernel: Hamming distance over the register set
+ * plus the whole SRAM snapshot, as dpasim computes it for every instruction of
+ * reference and verification traces or when tracking is off. Tracked traces
+ * only scan the RAM ranges their reference changed and are not covered here.
+ * Results are emitted as a JSON object on stdout. */
+int main(int argc, char **argv) {
+	static uint32_t prev_ram[RAM_SIZE_KB * 1024 / 4];
+	static uint32_t now_ram[RAM_SIZE_KB * 1024 / 4];
+	uint32_t prev_regs[16], now_regs[16];
+	const unsigned int ram_words = RAM_SIZE_KB * 1024 / 4;
+
+	uint32_t prng_state = BENCH_SEED;
+	for (unsigned int i = 0; i < ram_words; i++) {
+		prev_ram[i] = prng_next(&prng_state);
+	}
+	memcpy(now_ram, prev_ram, sizeof(now_ram));
+	for (unsigned int i = 0; i < 16; i++) {
+		prev_regs[i] = prng_next(&prng_state);
+		now_regs[i] = prng_next(&prng_state);
+	}
+
+	/* Like a real instruction, every step only touches a single RAM word */
+	unsigned long long steps = 0;
+	unsigned long long checksum = 0;
+	const double t0 = now_secs();
+	double t1;
+	do {
+		for (unsigned int i = 0; i < 64; i++) {
+			now_ram[prng_next(&prng_state) % ram_words] ^= prng_next(&prng_state);
+			checksum += leakage_hamming_distance(prev_regs, now_regs, 16);
+			checksum += leakage_hamming_distance(prev_ram, now_ram, ram_words);
+			memcpy(prev_ram, now_ram, sizeof(now_ram));
+			steps++;
+		}
+		t1 = now_secs();
+	} while (t1 - t0 < BENCH_MIN_RUNTIME_SECS);
+
+	const double runtime = t1 - t0;
+	printf("{\"benchmark\": \"leakage_kernel\", \"seed\": %u, \"ram_size_kb\": %d, \"steps\": %llu, \"runtime_secs\": %.6f, \"steps_per_sec\": %.1f, \"bytes_per_sec\": %.1f, \"checksum\": %llu}\n", BENCH_SEED, RAM_SIZE_KB, steps, runtime, steps / runtime, steps * (16.0 * 4 + sizeof(now_ram)) / runtime, checksum);
+	return 0;
+}
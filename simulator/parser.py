@@ -3,4 +3,6 @@ parser = argparse.ArgumentParser(prog = "trace_simulator", description = "Emulat
 parser.add_argument("-f", "--firmware", metavar = "filename", default = "aes128_rom.bin", help = "The firmware file to emulate. Defaults to %(default)s.")
 parser.add_argument("-n", "--tracecnt", metavar = "count", type = int, default = 1000, help = "An integer that specifies the amount of traces to generate by default. Defaults to %(default)d.")
 parser.add_argument("-k", "--key", metavar = "key", help = "Gives the key to feed the implementation. By default the key is entirely zeros.")
+parser.add_argument("-s", "--seed", metavar = "seed", help = "Seed the plaintext generator with this integer value to get a reproducible set of traces. By default, plaintexts are read from /dev/urandom.")
+parser.add_argument("-r", "--track-ram", action = "store_true", help = "Only scan the RAM words that the reference trace changed instead of all RAM for every instruction. Much faster, but a word that is changed and restored within one instruction window goes unnoticed; tracked traces are periodically compared to a full scan and tracking is switched off when they differ.")
 parser.add_argument("output_directory", metavar = "path", help = "Output directory to write tracefiles into.")
@@ -1,135 +1,42 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/stat.h>
-#include <thumb2sim/thumb2sim.h>
+#include <unistd.h>
 #include "argparse.h"
+#include "dpasim.h"
+#include "trace_writer.h"
 
 static struct pgmopts_t {
 	const char *output_directory;
 	const char *firmware_filename;
 	unsigned int trace_count;
+	bool have_seed;
+	uint64_t seed;
+	bool track_ram;
 	uint8_t key[64];
 } pgmopts = {
 	.firmware_filename = ARGPARSE_DEFAULT_FIRMWARE,
 	.trace_count = ARGPARSE_DEFAULT_TRACECNT,
 };
 
-#define MAX_TRACE_LENGTH		(32 * 1024)
-#define RAM_SIZE_KB				128
-
-struct user_ctx_t {
-	bool end_emulation;
-	int readstate;
-	uint8_t key[16];
-	uint8_t plaintext[16];
-	uint8_t ciphertext[16];
-	unsigned int trace_length;
-	uint8_t trace[MAX_TRACE_LENGTH];
-	struct cm3_cpu_state_t prev_regs;
-	uint8_t prev_ram[RAM_SIZE_KB * 1024];
-};
-
-#define READSTATE_READ_KEY			1
-#define READSTATE_READ_PLAINTEXT	2
-#define READSTATE_WRITE_KEY			3
-#define READSTATE_WRITE_PLAINTEXT	4
-#define READSTATE_WRITE_CIPHERTEXT	5
-
-#define BREAKPOINT_START_AES		1
-#define BREAKPOINT_END_AES			2
-
-static unsigned int hweight(uint32_t x) {
-	unsigned int weight = 0;
-	while (x) {
-		if (x & 1) {
-			weight++;
-		}
-		x >>= 1;
-	}
-	return weight;
+/* xorshift64*; only used to make plaintexts reproducible when a seed is
+ * given, this is not a cryptographic generator. */
+static uint64_t prng_next(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
 }
 
-static void post_step_callback(struct emu_ctx_t *emu_ctx) {
-	struct user_ctx_t *usr = (struct user_ctx_t*)emu_ctx->user;
-
-
-	unsigned int bits_flipped_regs = 0;
-	for (int i = 0; i < 16; i++) {
-		int w = hweight(emu_ctx->cpu.reg[i] ^ usr->prev_regs.reg[i]);
-		bits_flipped_regs += w;
-	}
-
-	const uint32_t *prev_ram = (uint32_t*)usr->prev_ram;
-	const uint32_t *now_ram = (uint32_t*)emu_ctx->addr_space.slices[1].data;
-	for (int i = 0; i < RAM_SIZE_KB * 1024 / 4; i++) {
-		int w = hweight(prev_ram[i] ^ now_ram[i]);
-		bits_flipped_regs += w;
-	}
-	memcpy(&usr->prev_regs, &emu_ctx->cpu, sizeof(struct cm3_cpu_state_t));
-	memcpy(usr->prev_ram, now_ram, RAM_SIZE_KB * 1024);
-
-	if (bits_flipped_regs > 255) {
-		fprintf(stderr, "Register hamming weight clipped from %d\n", bits_flipped_regs);
-		bits_flipped_regs = 255;
-	}
-
-	if (usr->trace_length < MAX_TRACE_LENGTH) {
-		usr->trace[usr->trace_length] = bits_flipped_regs;
-		usr->trace_length++;
-	} else {
-		fprintf(stderr, "Trace truncated!\n");
-	}
-}
-
-static void bkpt_callback(struct emu_ctx_t *emu_ctx, uint8_t bkpt_number) {
-	struct user_ctx_t *usr = (struct user_ctx_t*)emu_ctx->user;
-	if (bkpt_number == BREAKPOINT_START_AES) {
-		emu_ctx->post_step_callback = post_step_callback;
-		memcpy(&usr->prev_regs, &emu_ctx->cpu, sizeof(struct cm3_cpu_state_t));
-		memcpy(usr->prev_ram, emu_ctx->addr_space.slices[1].data, RAM_SIZE_KB * 1024);
-	} else if (bkpt_number == BREAKPOINT_END_AES) {
-		emu_ctx->post_step_callback = NULL;
-	} else if (bkpt_number != 255) {
-		fprintf(stderr, "Unexpected breakpoint %d.\n", bkpt_number);
-	}
-}
-
-static uint32_t syscall_read(struct emu_ctx_t *emu_ctx, void *data, uint32_t max_length) {
-	struct user_ctx_t *usr = (struct user_ctx_t*)emu_ctx->user;
-	usr->readstate++;
-
-	if (usr->readstate == READSTATE_READ_KEY) {
-		uint8_t *key = (uint8_t*)data;
-		memcpy(key, usr->key, 16);
-	} else if (usr->readstate == READSTATE_READ_PLAINTEXT) {
-		uint8_t *plaintext = (uint8_t*)data;
-		memcpy(plaintext, usr->plaintext, 16);
-	} else {
-		fprintf(stderr, "Unexpected read %d\n", usr->readstate);
-	}
-	return max_length;
-}
-
-static bool end_emulation_callback(struct emu_ctx_t *emu_ctx) {
-	struct user_ctx_t *usr = (struct user_ctx_t*)emu_ctx->user;
-	return usr->end_emulation;
-}
-
-static void syscall_write(struct emu_ctx_t *emu_ctx, const void *data, uint32_t length) {
-	struct user_ctx_t *usr = (struct user_ctx_t*)emu_ctx->user;
-	usr->readstate++;
-	if (usr->readstate == READSTATE_WRITE_CIPHERTEXT) {
-		uint8_t *ciphertext = (uint8_t*)data;
-		memcpy(usr->ciphertext, ciphertext, 16);
+static void prng_fill(uint64_t *state, uint8_t *data, unsigned int length) {
+	for (unsigned int i = 0; i < length; i += 8) {
+		uint64_t value = prng_next(state);
+		for (unsigned int j = 0; (j < 8) && (i + j < length); j++) {
+			data[i + j] = value >> (8 * j);
+		}
 	}
 }
 
-static void syscall_exit(struct emu_ctx_t *emu_ctx, uint32_t status) {
-	struct user_ctx_t *usr = (struct user_ctx_t*)emu_ctx->user;
-	usr->end_emulation = true;
-}
-
 static bool parse_hex(uint8_t *dest, const char *src, unsigned int max_length, argparse_errmsg_callback_t errmsg_callback) {
 	int sl = strlen(src);
 	if ((sl % 2) != 0) {
@@ -161,6 +68,46 @@ static bool parse_hex(uint8_t *dest, const char *src, unsigned int max_length, a
 	return true;
 }
 
+/* The sample to instruction map is identical for all traces of a firmware, so
+ * it is written once per output directory */
+static void write_sample_map(const struct dpasim_ctx_t *sim, const char *output_directory) {
+	const unsigned int entry_count = dpasim_sample_map(sim, NULL, 0);
+	if (entry_count == 0) {
+		return;
+	}
+	struct dpasim_map_entry_t *entries = malloc(sizeof(struct dpasim_map_entry_t) * entry_count);
+	if (!entries) {
+		perror("malloc");
+		exit(1);
+	}
+	dpasim_sample_map(sim, entries, entry_count);
+
+	/* Several simulators may share the same output directory, so the map is
+	 * replaced atomically */
+	char filename[4096], tmp_filename[4096];
+	snprintf(filename, sizeof(filename), "%s/sample_map.json", output_directory);
+	snprintf(tmp_filename, sizeof(tmp_filename), "%s/sample_map.json.%d", output_directory, (int)getpid());
+	FILE *f = fopen(tmp_filename, "w");
+	if (!f) {
+		perror(tmp_filename);
+		exit(1);
+	}
+	fprintf(f, "{\n\t\"columns\": [ \"sample_start\", \"count\", \"pc_start\", \"pc_stride\" ],\n\t\"entries\": [\n");
+	for (unsigned int i = 0; i < entry_count; i++) {
+		fprintf(f, "\t\t[ %u, %u, %u, %d ]%s\n", entries[i].sample_start, entries[i].count, entries[i].pc_start, entries[i].pc_stride, (i + 1 < entry_count) ? "," : "");
+	}
+	fprintf(f, "\t]\n}\n");
+	if (fclose(f) != 0) {
+		perror(tmp_filename);
+		exit(1);
+	}
+	if (rename(tmp_filename, filename) != 0) {
+		perror(filename);
+		exit(1);
+	}
+	free(entries);
+}
+
 static bool argument_callback(enum argparse_option_t option, const char *value, argparse_errmsg_callback_t errmsg_callback) {
 	switch (option) {
 		case ARG_FIRMWARE:
@@ -171,6 +118,15 @@ static bool argument_callback(enum argparse_option_t option, const char *value,
 			pgmopts.trace_count = atoi(value);
 			break;
 
+		case ARG_SEED:
+			pgmopts.have_seed = true;
+			pgmopts.seed = strtoull(value, NULL, 0);
+			break;
+
+		case ARG_TRACK_RAM:
+			pgmopts.track_ram = true;
+			break;
+
 		case ARG_OUTPUT_DIRECTORY:
 			pgmopts.output_directory = value;
 			break;
@@ -193,73 +149,52 @@ int main(int argc, char **argv) {
 
 
 
-	const char *rom_image_filename = "aes128_rom.bin";
-	const struct hardware_params_t cpu_parameters = {
-		.rom_size_bytes = 1024 * 1024,
-		.ram_size_bytes = RAM_SIZE_KB * 1024,
-		.ivt_base_address = 0x08000000,
-		.rom_base_address = 0x08000000,
-		.ram_base_address = 0x20000000,
-		.rom_image_filename = rom_image_filename,
-		.ram_image_filename = NULL,
-	};
-
-	struct emu_ctx_t *emu_ctx = init_cortexm(&cpu_parameters);
-	emu_ctx->bkpt_callback = bkpt_callback;
-	emu_ctx->end_emulation_callback = end_emulation_callback;
-	emu_ctx->emulator_syscall_read = syscall_read;
-	emu_ctx->emulator_syscall_write = syscall_write;
-	emu_ctx->emulator_syscall_exit = syscall_exit;
-
-	FILE *f = fopen("/dev/urandom", "r");
-	if (!f) {
-		perror("/dev/urandom");
+	struct dpasim_ctx_t *sim = dpasim_init(pgmopts.firmware_filename);
+	if (!sim) {
+		fprintf(stderr, "Unable to initialize emulator with %s.\n", pgmopts.firmware_filename);
 		exit(1);
 	}
-
-	for (unsigned int trace_no = 0; trace_no < pgmopts.trace_count; trace_no++) {
-		struct user_ctx_t user = {
-			.end_emulation = false,
-			.readstate = 0,
-		};
-		memcpy(user.key, pgmopts.key, 16);
-		emu_ctx->user = &user;
-		if (fread(user.plaintext, 16, 1, f) != 1) {
-			perror("fread");
+	dpasim_set_ram_tracking(sim, pgmopts.track_ram);
+
+	FILE *f = NULL;
+	uint64_t prng_state = pgmopts.seed ^ 0x9e3779b97f4a7c15ULL;
+	if (!pgmopts.have_seed) {
+		f = fopen("/dev/urandom", "r");
+		if (!f) {
+			perror("/dev/urandom");
 			exit(1);
 		}
+	}
 
-		cpu_reset(emu_ctx);
-		cpu_run(emu_ctx);
-
-		mkdir(pgmopts.output_directory, 0755);
+	struct trace_writer_t *writer = trace_writer_init(pgmopts.output_directory, TRACE_WRITER_DEFAULT_SLOTS);
+	if (!writer) {
+		fprintf(stderr, "Unable to start trace writer.\n");
+		exit(1);
+	}
 
-		/* Yes, this sprintf/strlen cascade is neither efficient nor secure
-		 * (buffer overflow). Send a PR if you care. */
-		char output_filename[256];
-		output_filename[0] = 0;
-		sprintf(output_filename + strlen(output_filename), "%s/trace_P_", pgmopts.output_directory);
-		for (int i = 0; i < 16; i++) {
-			sprintf(output_filename + strlen(output_filename), "%02x", user.plaintext[i]);
-		}
-		sprintf(output_filename + strlen(output_filename), "_C_");
-		for (int i = 0; i < 16; i++) {
-			sprintf(output_filename + strlen(output_filename), "%02x", user.ciphertext[i]);
+	for (unsigned int trace_no = 0; trace_no < pgmopts.trace_count; trace_no++) {
+		struct trace_record_t *record = trace_writer_next_record(writer);
+		uint8_t randomness[16];
+		if (f) {
+			if ((fread(record->plaintext, 16, 1, f) != 1) || (fread(randomness, 16, 1, f) != 1)) {
+				perror("fread");
+				exit(1);
+			}
+		} else {
+			prng_fill(&prng_state, record->plaintext, 16);
+			prng_fill(&prng_state, randomness, 16);
 		}
-		sprintf(output_filename + strlen(output_filename), ".bin");
-		printf("%s\n", output_filename);
 
-		FILE *j = fopen(output_filename, "w");
-		if (!j) {
-			perror(output_filename);
-			exit(1);
-		}
-		if (fwrite(user.trace, user.trace_length, 1, j) != 1) {
-			perror("fwrite");
-			exit(1);
+		/* The emulator records directly into the writer's ring; filename
+		 * formatting and I/O happen on the writer thread */
+		if (!dpasim_generate(sim, pgmopts.key, 0, record->plaintext, randomness, 1, record->trace, MAX_TRACE_LENGTH, &record->trace_length, record->ciphertext)) {
+			fprintf(stderr, "Trace truncated!\n");
 		}
-		fclose(j);
+		trace_writer_submit(writer);
 	}
+	trace_writer_free(writer);
+	write_sample_map(sim, pgmopts.output_directory);
+	dpasim_free(sim);
 
 	return 0;
 }
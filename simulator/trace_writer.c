@@ -0,0 +1,176 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "trace_writer.h"
+
+static void write_record(const struct trace_record_t *record, char *filename, size_t prefix_length) {
+	static const char hexdigits[] = "0123456789abcdef";
+	char *p = filename + prefix_length;
+	memcpy(p, "trace_P_", 8);
+	p += 8;
+	for (int i = 0; i < 16; i++) {
+		*p++ = hexdigits[record->plaintext[i] >> 4];
+		*p++ = hexdigits[record->plaintext[i] & 0xf];
+	}
+	memcpy(p, "_C_", 3);
+	p += 3;
+	for (int i = 0; i < 16; i++) {
+		*p++ = hexdigits[record->ciphertext[i] >> 4];
+		*p++ = hexdigits[record->ciphertext[i] & 0xf];
+	}
+	memcpy(p, ".bin", 5);
+
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		perror(filename);
+		exit(1);
+	}
+	const uint8_t *data = record->trace;
+	size_t remaining = record->trace_length;
+	while (remaining > 0) {
+		ssize_t written = write(fd, data, remaining);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("write");
+			exit(1);
+		}
+		data += written;
+		remaining -= written;
+	}
+	if (close(fd) != 0) {
+		perror("close");
+		exit(1);
+	}
+	printf("%s\n", filename);
+}
+
+static void *writer_thread(void *vwriter) {
+	struct trace_writer_t *writer = (struct trace_writer_t*)vwriter;
+
+	/* The directory prefix of all filenames is only formatted once */
+	char filename[4096];
+	int prefix_length = snprintf(filename, sizeof(filename), "%s/", writer->output_directory);
+	if ((prefix_length < 0) || ((size_t)prefix_length + 128 > sizeof(filename))) {
+		fprintf(stderr, "Output directory name too long: %s\n", writer->output_directory);
+		exit(1);
+	}
+
+	pthread_mutex_lock(&writer->lock);
+	while (true) {
+		while ((writer->consumed == writer->produced) && !writer->finished) {
+			pthread_cond_wait(&writer->record_available, &writer->lock);
+		}
+		if (writer->consumed == writer->produced) {
+			break;
+		}
+
+		/* The record is owned by the writer until it has been consumed, so
+		 * the I/O itself is done without holding the lock */
+		const struct trace_record_t *record = &writer->records[writer->consumed % writer->slot_count];
+		pthread_mutex_unlock(&writer->lock);
+		write_record(record, filename, prefix_length);
+		pthread_mutex_lock(&writer->lock);
+
+		writer->consumed++;
+		pthread_cond_signal(&writer->slot_available);
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return NULL;
+}
+
+struct trace_writer_t *trace_writer_init(const char *output_directory, unsigned int slot_count) {
+	if ((mkdir(output_directory, 0755) != 0) && (errno != EEXIST)) {
+		perror(output_directory);
+		return NULL;
+	}
+
+	struct trace_writer_t *writer = calloc(1, sizeof(struct trace_writer_t));
+	if (!writer) {
+		return NULL;
+	}
+	writer->output_directory = output_directory;
+	writer->slot_count = (slot_count > 0) ? slot_count : TRACE_WRITER_DEFAULT_SLOTS;
+	writer->records = malloc(sizeof(struct trace_record_t) * writer->slot_count);
+	if (!writer->records) {
+		free(writer);
+		return NULL;
+	}
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->record_available, NULL);
+	pthread_cond_init(&writer->slot_available, NULL);
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0) {
+		pthread_cond_destroy(&writer->slot_available);
+		pthread_cond_destroy(&writer->record_available);
+		pthread_mutex_destroy(&writer->lock);
+		free(writer->records);
+		free(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+/* Returns the record the producer fills next. Blocks only when all slots are
+ * still waiting to be written. */
+struct trace_record_t *trace_writer_next_record(struct trace_writer_t *writer) {
+	pthread_mutex_lock(&writer->lock);
+	while (writer->produced - writer->consumed == writer->slot_count) {
+		pthread_cond_wait(&writer->slot_available, &writer->lock);
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return &writer->records[writer->produced % writer->slot_count];
+}
+
+/* Hands the record previously returned by trace_writer_next_record() to the
+ * writer thread. */
+void trace_writer_submit(struct trace_writer_t *writer) {
+	pthread_mutex_lock(&writer->lock);
+	writer->produced++;
+	pthread_cond_signal(&writer->record_available);
+	pthread_mutex_unlock(&writer->lock);
+}
+
+/* Writes all submitted records that are still pending, then stops the writer
+ * thread. */
+void trace_writer_free(struct trace_writer_t *writer) {
+	pthread_mutex_lock(&writer->lock);
+	writer->finished = true;
+	pthread_cond_signal(&writer->record_available);
+	pthread_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+	pthread_cond_destroy(&writer->slot_available);
+	pthread_cond_destroy(&writer->record_available);
+	pthread_mutex_destroy(&writer->lock);
+	free(writer->records);
+	free(writer);
+}
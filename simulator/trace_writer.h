@@ -0,0 +1,64 @@
+/**
+ *	dpa-simulator - Create simulated traces for demonstrating basic DPA/CPA.
+ *	Copyright (C) 2022-2022 Johannes Bauer
+ *
+ *	This file is part of dpa-simulator.
+ *
+ *	dpa-simulator is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; this program is ONLY licensed under
+ *	version 3 of the License, later versions are explicitly excluded.
+ *
+ *	dpa-simulator is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with dpa-simulator; if not, write to the Free Software
+ *	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *	Johannes Bauer <JohannesBauer@gmx.de>
+**/
+
+#ifndef __TRACE_WRITER_H__
+#define __TRACE_WRITER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define MAX_TRACE_LENGTH				(32 * 1024)
+#define TRACE_WRITER_DEFAULT_SLOTS		64
+
+struct trace_record_t {
+	uint8_t plaintext[16];
+	uint8_t ciphertext[16];
+	uint32_t trace_length;
+	uint8_t trace[MAX_TRACE_LENGTH];
+};
+
+/* Single producer, single consumer ring of preallocated trace records. The
+ * emulator fills records and submits them, the writer thread stores them in
+ * the output directory in submission order. */
+struct trace_writer_t {
+	const char *output_directory;
+	unsigned int slot_count;
+	struct trace_record_t *records;
+	unsigned int produced;
+	unsigned int consumed;
+	bool finished;
+	pthread_mutex_t lock;
+	pthread_cond_t record_available;
+	pthread_cond_t slot_available;
+	pthread_t thread;
+};
+
+/*************** AUTO GENERATED SECTION FOLLOWS ***************/
+struct trace_writer_t *trace_writer_init(const char *output_directory, unsigned int slot_count);
+struct trace_record_t *trace_writer_next_record(struct trace_writer_t *writer);
+void trace_writer_submit(struct trace_writer_t *writer);
+void trace_writer_free(struct trace_writer_t *writer);
+/***************  AUTO GENERATED SECTION ENDS   ***************/
+
+#endif